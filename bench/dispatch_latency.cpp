@@ -0,0 +1,106 @@
+/*
+    Measures the latency between submitting a task to an idle pool and the task starting on a
+    worker. Compares workers that park immediately (spin count of 0) against workers that spin
+    before parking.
+
+    Usage: dr-app-bench-dispatch [num_samples] [idle_time_us]
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <dr/basic_types.hpp>
+#include <dr/dynamic_array.hpp>
+
+#include <dr/app/thread_pool.hpp>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+dr::i64 now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+}
+
+struct Result
+{
+    dr::i64 p50;
+    dr::i64 p99;
+};
+
+Result measure(
+    dr::WorkerPool& pool,
+    dr::isize const spin_count,
+    dr::isize const num_samples,
+    dr::i64 const idle_time_us)
+{
+    using namespace dr;
+
+    pool.set_spin_count(spin_count);
+
+    std::atomic<i64> start_time{0};
+    auto const probe = [&]() -> void { start_time.store(now_ns()); };
+
+    DynamicArray<i64> samples{};
+    samples.reserve(num_samples);
+
+    for (isize i = 0; i < num_samples; ++i)
+    {
+        start_time = 0;
+        i64 const submit_time = now_ns();
+        pool.submit(&probe);
+
+        // NOTE: Calling thread doesn't help so the task always runs on a worker
+        while (start_time.load() == 0)
+            std::this_thread::yield();
+
+        samples.push_back(start_time.load() - submit_time);
+
+        // Busy-wait so workers have time to go idle before the next submission
+        auto const resume_time = Clock::now() + std::chrono::microseconds(idle_time_us);
+        while (Clock::now() < resume_time)
+            ;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return {samples[num_samples / 2], samples[num_samples * 99 / 100]};
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    using namespace dr;
+
+    isize const num_samples = (argc > 1) ? std::max(std::atoi(argv[1]), 1) : 10000;
+    i64 const idle_time_us = (argc > 2) ? std::atoi(argv[2]) : 50;
+
+    WorkerPool pool{};
+    pool.start(std::max<isize>(std::thread::hardware_concurrency() - 1, 1));
+
+    std::printf(
+        "Submit-to-start latency (%td samples, %lld us idle)\n",
+        num_samples,
+        static_cast<long long>(idle_time_us));
+
+    for (isize const spin_count : {0, 64, 256, 1024})
+    {
+        Result const r = measure(pool, spin_count, num_samples, idle_time_us);
+        std::printf(
+            "  spin_count %5td: p50 %8lld ns, p99 %8lld ns\n",
+            spin_count,
+            static_cast<long long>(r.p50),
+            static_cast<long long>(r.p99));
+    }
+
+    pool.stop();
+    return 0;
+}
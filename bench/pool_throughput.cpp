@@ -0,0 +1,189 @@
+/*
+    Measures task throughput of a pool across worker counts. Tasks are either submitted from
+    outside the pool (going through the injection queue) or spawned by other tasks (going through
+    worker deques and stealing).
+
+    Each measurement is repeated with a baseline pool that has a single task queue guarded by a
+    mutex and condition variable, as ThreadPool had before work stealing.
+
+    Usage: dr-app-bench-throughput [num_tasks] [max_workers]
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#include <dr/basic_types.hpp>
+#include <dr/deque.hpp>
+#include <dr/dynamic_array.hpp>
+
+#include <dr/app/task_ref.hpp>
+#include <dr/app/thread_pool.hpp>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+/// Pool where every worker takes tasks from one central queue
+struct CentralQueuePool
+{
+    CentralQueuePool(dr::isize const num_workers) : workers_(num_workers)
+    {
+        for (auto& worker : workers_)
+            worker = std::thread{[this]() { do_work(); }};
+    }
+
+    ~CentralQueuePool()
+    {
+        // Queue an invalid task for each worker
+        {
+            std::scoped_lock const lock{mutex_};
+            for ([[maybe_unused]] auto const& worker : workers_)
+                tasks_.push_back(dr::TaskRef{});
+        }
+        condition_.notify_all();
+
+        for (auto& worker : workers_)
+            worker.join();
+    }
+
+    void submit(dr::TaskRef const& task)
+    {
+        {
+            std::scoped_lock const lock{mutex_};
+            tasks_.push_back(task);
+        }
+        condition_.notify_one();
+    }
+
+  private:
+    dr::DynamicArray<std::thread> workers_;
+    dr::Deque<dr::TaskRef> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+
+    void do_work()
+    {
+        while (true)
+        {
+            dr::TaskRef task{};
+            {
+                std::unique_lock lock{mutex_};
+                condition_.wait(lock, [&]() { return !tasks_.empty(); });
+
+                task = tasks_.front();
+                tasks_.pop_front();
+            }
+
+            if (!task.is_valid())
+                return;
+
+            task();
+        }
+    }
+};
+
+/// Returns millions of tasks per second for tasks submitted from the calling thread
+template <typename Pool>
+dr::f64 measure_external(Pool& pool, dr::isize const num_tasks)
+{
+    using namespace dr;
+
+    std::atomic<isize> count{0};
+    auto const empty = [&]() -> void { count.fetch_add(1, std::memory_order_relaxed); };
+
+    auto const start_time = Clock::now();
+
+    for (isize i = 0; i < num_tasks; ++i)
+        pool.submit(&empty);
+
+    // NOTE: Calling thread doesn't help so only workers are measured
+    while (count.load() < num_tasks)
+        std::this_thread::yield();
+
+    std::chrono::duration<f64> const elapsed = Clock::now() - start_time;
+    return num_tasks / elapsed.count() * 1.0e-6;
+}
+
+/// Returns millions of tasks per second for tasks spawned by other tasks
+template <typename Pool>
+dr::f64 measure_nested(Pool& pool, dr::isize const num_tasks)
+{
+    using namespace dr;
+
+    constexpr isize num_children = 1000;
+    isize const num_parents = std::max<isize>(num_tasks / num_children, 1);
+    isize const total = num_parents * (num_children + 1);
+
+    std::atomic<isize> count{0};
+    auto const empty = [&]() -> void { count.fetch_add(1, std::memory_order_relaxed); };
+    auto const spawn = [&]() -> void {
+        for (isize i = 0; i < num_children; ++i)
+            pool.submit(&empty);
+
+        count.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    auto const start_time = Clock::now();
+
+    for (isize i = 0; i < num_parents; ++i)
+        pool.submit(&spawn);
+
+    while (count.load() < total)
+        std::this_thread::yield();
+
+    std::chrono::duration<f64> const elapsed = Clock::now() - start_time;
+    return total / elapsed.count() * 1.0e-6;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    using namespace dr;
+
+    isize const num_tasks = (argc > 1) ? std::max(std::atoi(argv[1]), 1) : 2000000;
+    isize const max_workers = (argc > 2)
+        ? std::clamp<isize>(std::atoi(argv[2]), 1, WorkerPool::max_workers)
+        : std::max<isize>(std::thread::hardware_concurrency(), 1);
+
+    std::printf("Task throughput (%td tasks, Mtask/s)\n", num_tasks);
+    std::printf("             work stealing      central queue\n");
+    std::printf("  workers  external   nested  external   nested\n");
+
+    for (isize num_workers = 1; num_workers <= max_workers; num_workers *= 2)
+    {
+        f64 stealing[2];
+        {
+            WorkerPool pool{};
+            pool.start(num_workers);
+
+            stealing[0] = measure_external(pool, num_tasks);
+            stealing[1] = measure_nested(pool, num_tasks);
+            pool.stop();
+        }
+
+        f64 central[2];
+        {
+            CentralQueuePool pool{num_workers};
+            central[0] = measure_external(pool, num_tasks);
+            central[1] = measure_nested(pool, num_tasks);
+        }
+
+        std::printf(
+            "  %7td  %8.2f %8.2f  %8.2f %8.2f\n",
+            num_workers,
+            stealing[0],
+            stealing[1],
+            central[0],
+            central[1]);
+    }
+
+    return 0;
+}
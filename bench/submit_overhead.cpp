@@ -0,0 +1,138 @@
+/*
+    Measures the cost of submitting tasks on the submitting thread. Compares submitting tasks one
+    at a time against submitting them as a single batch, along with a TaskQueue poll that submits
+    all of its queued tasks at once.
+
+    Usage: dr-app-bench-submit [num_tasks] [num_rounds]
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <dr/basic_types.hpp>
+#include <dr/dynamic_array.hpp>
+#include <dr/span.hpp>
+
+#include <dr/app/task_queue.hpp>
+#include <dr/app/thread_pool.hpp>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+enum Mode : dr::u8
+{
+    Mode_Single = 0,
+    Mode_Batch,
+    Mode_Queue,
+    _Mode_Count,
+};
+
+char const* const mode_names[] = {
+    "submit (single)",
+    "submit (batch)",
+    "TaskQueue::poll",
+};
+
+/// Returns the median time spent submitting per task in nanoseconds
+dr::f64 measure(
+    dr::WorkerPool& pool,
+    Mode const mode,
+    dr::isize const num_tasks,
+    dr::isize const num_rounds)
+{
+    using namespace dr;
+
+    std::atomic<isize> count{0};
+    auto const empty = [&]() -> void { count.fetch_add(1, std::memory_order_relaxed); };
+
+    DynamicArray<TaskRef> tasks(num_tasks, &empty);
+    TaskQueue queue{pool};
+
+    DynamicArray<f64> samples{};
+    samples.reserve(num_rounds);
+
+    for (isize round = 0; round < num_rounds; ++round)
+    {
+        count = 0;
+
+        // NOTE: Tasks are pushed ahead of time so only submission is measured
+        if (mode == Mode_Queue)
+        {
+            for (isize i = 0; i < num_tasks; ++i)
+                queue.push(&empty);
+        }
+
+        auto const start_time = Clock::now();
+
+        switch (mode)
+        {
+            case Mode_Single:
+            {
+                for (isize i = 0; i < num_tasks; ++i)
+                    pool.submit(tasks[i]);
+
+                break;
+            }
+            case Mode_Batch:
+            {
+                pool.submit(Span<TaskRef const>{tasks.data(), num_tasks});
+                break;
+            }
+            case Mode_Queue:
+            {
+                queue.poll();
+                break;
+            }
+            default:
+            {
+            }
+        }
+
+        std::chrono::duration<f64, std::nano> const elapsed = Clock::now() - start_time;
+        samples.push_back(elapsed.count() / num_tasks);
+
+        // Let the pool drain before the next round
+        while (count.load() < num_tasks)
+            std::this_thread::yield();
+
+        queue.wait();
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return samples[num_rounds / 2];
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    using namespace dr;
+
+    isize const num_tasks = (argc > 1) ? std::max(std::atoi(argv[1]), 1) : 5000;
+    isize const num_rounds = (argc > 2) ? std::max(std::atoi(argv[2]), 1) : 50;
+
+    WorkerPool pool{};
+    pool.start(std::max<isize>(std::thread::hardware_concurrency() - 1, 1));
+
+    std::printf(
+        "Submission cost per task (%td tasks, %td rounds, %td workers)\n",
+        num_tasks,
+        num_rounds,
+        pool.num_workers());
+
+    for (isize i = 0; i < _Mode_Count; ++i)
+    {
+        Mode const mode = static_cast<Mode>(i);
+        f64 const time = measure(pool, mode, num_tasks, num_rounds);
+        std::printf("  %-16s %8.1f ns\n", mode_names[i], time);
+    }
+
+    pool.stop();
+    return 0;
+}
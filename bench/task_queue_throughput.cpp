@@ -0,0 +1,104 @@
+/*
+    Measures the cost of pushing many small tasks onto a TaskQueue and polling them to completion
+    while workers complete tasks concurrently. With this many tasks in flight, the time is dominated
+    by per-task overhead in the queue (e.g. cache lines bouncing between workers writing task status
+    and the polling thread).
+
+    Configure with DR_APP_TASK_QUEUE_PACKED=ON to measure the baseline layout where tasks aren't
+    padded to cache lines. The layout measured is included in the report.
+
+    Usage: dr-app-bench-task-queue [num_tasks] [num_rounds]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include <dr/basic_types.hpp>
+#include <dr/dynamic_array.hpp>
+
+#include <dr/app/task_queue.hpp>
+#include <dr/app/thread_pool.hpp>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+#ifdef DR_APP_TASK_QUEUE_PACKED
+constexpr char const* layout_name = "packed";
+#else
+constexpr char const* layout_name = "cache-line-aligned";
+#endif
+
+/// Small task that writes to its own cache line so any sharing comes from the queue itself
+struct alignas(64) Work
+{
+    dr::u64 seed;
+    dr::u64 result;
+
+    void operator()()
+    {
+        dr::u64 x = seed;
+        for (int i = 0; i < 16; ++i)
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+
+        result = x;
+    }
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    using namespace dr;
+
+    isize const num_tasks = (argc > 1) ? std::max(std::atoi(argv[1]), 1) : 4096;
+    isize const num_rounds = (argc > 2) ? std::max(std::atoi(argv[2]), 1) : 100;
+
+    WorkerPool pool{};
+    pool.start(std::max<isize>(std::thread::hardware_concurrency() - 1, 1));
+
+    DynamicArray<Work> work(num_tasks);
+    for (isize i = 0; i < num_tasks; ++i)
+        work[i].seed = static_cast<u64>(i);
+
+    TaskQueue queue{pool};
+    DynamicArray<f64> samples{};
+    samples.reserve(num_rounds);
+
+    // NOTE: First round is a warm-up so the task pool is fully allocated before measuring
+    for (isize round = 0; round <= num_rounds; ++round)
+    {
+        auto const start_time = Clock::now();
+
+        for (Work& w : work)
+            queue.push(&w);
+
+        // NOTE: Calling thread only polls so it competes with workers for the queue's memory
+        while (queue.size() > 0)
+            queue.poll();
+
+        auto const elapsed = Clock::now() - start_time;
+        if (round > 0)
+            samples.push_back(std::chrono::duration<f64, std::nano>(elapsed).count() / num_tasks);
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    std::printf(
+        "Push-to-handled time per task (%td tasks, %td rounds, %td workers, %s layout)\n",
+        num_tasks,
+        num_rounds,
+        pool.num_workers(),
+        layout_name);
+    std::printf(
+        "  p50 %8.1f ns, p90 %8.1f ns\n",
+        samples[num_rounds / 2],
+        samples[num_rounds * 9 / 10]);
+
+    pool.stop();
+    return 0;
+}
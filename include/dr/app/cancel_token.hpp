@@ -0,0 +1,26 @@
+#pragma once
+
+#include <atomic>
+
+namespace dr
+{
+
+/// Lightweight view of a cancellation flag. Long-running tasks can check this periodically and
+/// return early once cancellation has been requested.
+struct CancelToken
+{
+    constexpr CancelToken() = default;
+
+    constexpr explicit CancelToken(std::atomic<bool> const* const flag) : flag_{flag} {}
+
+    /// Returns true if cancellation has been requested
+    bool is_requested() const { return flag_ != nullptr && flag_->load(std::memory_order_relaxed); }
+
+    /// Returns true if the instance refers to a flag
+    constexpr bool is_valid() const { return flag_ != nullptr; }
+
+  private:
+    std::atomic<bool> const* flag_{};
+};
+
+} // namespace dr
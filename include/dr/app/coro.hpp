@@ -0,0 +1,138 @@
+#pragma once
+
+/*
+    Coroutine front-end for WorkerPool and TaskQueue. Requires C++20 (see DR_APP_COROUTINES).
+
+    A Coro starts on the calling thread and moves between threads by awaiting resume_on. Awaiting
+    a pool continues the coroutine on one of its workers while awaiting a queue continues it on the
+    polling thread during the queue's next poll. This lets multi-step flows (e.g. read a file on a
+    worker, then upload it on the main thread) be written linearly instead of as chains of poll
+    callbacks.
+
+    Coroutine frames are allocated from a shared pool of fixed-size blocks so starting a coroutine
+    doesn't hit the general-purpose allocator once the pool has warmed up.
+*/
+
+#if !defined(__cpp_impl_coroutine)
+#error "dr/app/coro.hpp requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+
+#include <dr/basic_types.hpp>
+
+#include <dr/app/task_queue.hpp>
+#include <dr/app/thread_pool.hpp>
+
+namespace dr
+{
+
+/// Allocates a coroutine frame of the given size from the shared frame pool. Can be called from
+/// any thread.
+void* alloc_coro_frame(usize size);
+
+/// Returns a coroutine frame to the shared frame pool. The size must match the allocated size.
+void free_coro_frame(void* ptr, usize size);
+
+/// Fire-and-forget coroutine. Runs on the calling thread until its first suspension and destroys
+/// itself once it returns.
+struct Coro
+{
+    struct promise_type
+    {
+        Coro get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+
+        static void* operator new(std::size_t const size) { return alloc_coro_frame(size); }
+
+        static void operator delete(void* const ptr, std::size_t const size)
+        {
+            free_coro_frame(ptr, size);
+        }
+    };
+};
+
+/// Awaitable that resumes the awaiting coroutine on a worker
+struct ResumeOnPool
+{
+    WorkerPool* pool;
+    WorkerPool::Priority priority;
+    std::coroutine_handle<> handle{};
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> const awaiting)
+    {
+        handle = awaiting;
+
+        // NOTE: This awaiter lives in the coroutine frame until it's resumed
+        pool->submit(this, priority);
+    }
+
+    void await_resume() const noexcept {}
+
+    /// Resumes the awaiting coroutine
+    void operator()() const { handle.resume(); }
+};
+
+/// Awaitable that resumes the awaiting coroutine on the polling thread during the next poll. The
+/// resumed coroutine runs as part of the poll's event budget and must not poll, wait on, or cancel
+/// tasks in the queue before its next suspension. If cancelled (see TaskQueue::cancel_all), the
+/// coroutine is destroyed instead.
+struct ResumeOnPoll
+{
+    TaskQueue* queue;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> const awaiting)
+    {
+        queue->post(awaiting.address(), on_poll_event);
+    }
+
+    void await_resume() const noexcept {}
+
+  private:
+    static bool on_poll_event(TaskQueue::PollEvent const& event)
+    {
+        auto const handle = std::coroutine_handle<>::from_address(event.context);
+
+        switch (event.type)
+        {
+            case TaskQueue::PollEvent::AfterComplete:
+            {
+                handle.resume();
+                break;
+            }
+            case TaskQueue::PollEvent::Cancelled:
+            {
+                handle.destroy();
+                break;
+            }
+            default:
+            {
+            }
+        }
+
+        return true;
+    }
+};
+
+/// Returns an awaitable that continues the awaiting coroutine on a worker in the given pool
+inline ResumeOnPool resume_on(
+    WorkerPool& pool,
+    WorkerPool::Priority const priority = WorkerPool::Priority_Normal)
+{
+    return {&pool, priority};
+}
+
+/// Returns an awaitable that continues the awaiting coroutine on the thread that polls the given
+/// queue during its next poll
+inline ResumeOnPoll resume_on(TaskQueue& queue) { return {&queue}; }
+
+} // namespace dr
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+    Fork-join group of tasks running on the thread pool. Tasks in the group can spawn more tasks
+    into it. Once every task in the group has finished, a continuation is submitted directly by
+    the worker that finished last rather than waiting on the next TaskQueue::poll.
+*/
+
+#include <atomic>
+#include <mutex>
+
+#include <dr/allocator.hpp>
+#include <dr/basic_types.hpp>
+#include <dr/deque.hpp>
+#include <dr/dynamic_array.hpp>
+
+#include <dr/app/task_ref.hpp>
+#include <dr/app/thread_pool.hpp>
+
+namespace dr
+{
+
+struct TaskGroup : AllocatorAware
+{
+    TaskGroup(Allocator const alloc = {}) : nodes_(alloc), free_(alloc) {}
+
+    /// Creates a group that submits tasks to the given thread pool instead of the default one
+    TaskGroup(WorkerPool& thread_pool, Allocator const alloc = {}) : TaskGroup(alloc)
+    {
+        thread_pool_ = &thread_pool;
+    }
+
+    TaskGroup(TaskGroup const& other) = delete;
+    TaskGroup& operator=(TaskGroup const& other) = delete;
+
+    /// Returns the allocator used by this container
+    Allocator allocator() const { return nodes_.get_allocator(); }
+
+    /// Returns the thread pool that tasks are submitted to
+    WorkerPool& thread_pool() const
+    {
+        return (thread_pool_) ? *thread_pool_ : ThreadPool::instance();
+    }
+
+    /// Submits a task to the thread pool as part of the group. This can be called from within other
+    /// tasks in the group. The calling context is responsible for keeping the task alive until
+    /// completion.
+    void run(TaskRef const& task, WorkerPool::Priority priority = WorkerPool::Priority_Normal);
+
+    /// Sets a continuation that's submitted by whichever thread finishes the last task in the
+    /// group. If the group is already idle, the continuation is submitted immediately. The group
+    /// can be reused once the continuation has been submitted.
+    void then(
+        TaskRef const& continuation,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal);
+
+    /// Waits until every task in the group has finished. The calling thread runs pending tasks from
+    /// the thread pool while it waits.
+    void wait();
+
+    /// Returns true if there are no unfinished tasks or pending continuation in the group
+    bool is_idle() const { return state_.load(std::memory_order_acquire) == 0; }
+
+  private:
+    struct Node
+    {
+        TaskRef task;
+        TaskGroup* group;
+
+        /// Invokes the task then notifies the group
+        void operator()();
+    };
+
+    Node* make_node(TaskRef const& task);
+    void finish(Node* node);
+    void submit_continuation();
+
+    // Number of unfinished tasks in the upper bits, whether a continuation is set in the lowest bit
+    std::atomic<isize> state_{0};
+    TaskRef continuation_{};
+    WorkerPool::Priority continuation_priority_{};
+
+    Deque<Node> nodes_;
+    DynamicArray<Node*> free_;
+    std::mutex mutex_;
+    WorkerPool* thread_pool_{};
+};
+
+} // namespace dr
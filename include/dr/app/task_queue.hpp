@@ -1,18 +1,56 @@
 #pragma once
 
 #include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 #include <dr/allocator.hpp>
 #include <dr/basic_types.hpp>
 #include <dr/deque.hpp>
 #include <dr/dynamic_array.hpp>
+#include <dr/span.hpp>
 #include <dr/string.hpp>
 
+#include <dr/app/cancel_token.hpp>
 #include <dr/app/task_ref.hpp>
+#include <dr/app/task_stats.hpp>
+#include <dr/app/thread_pool.hpp>
+#include <dr/app/unique_task.hpp>
 
 namespace dr
 {
 
+/// Refers to a task pushed onto a TaskQueue. Task slots are reused once tasks are released so
+/// handles carry a generation to detect when the referenced task is gone.
+struct TaskHandle
+{
+    constexpr TaskHandle() = default;
+
+    /// Returns true if the handle refers to a task
+    constexpr bool is_valid() const { return task_ != nullptr; }
+    constexpr explicit operator bool() const { return is_valid(); }
+
+  private:
+    void* task_{};
+    u32 generation_{};
+
+    constexpr TaskHandle(void* const task, u32 const generation) :
+        task_{task},
+        generation_{generation}
+    {
+    }
+
+    friend struct TaskQueue;
+};
+
+template <typename T>
+struct TaskFuture;
+
 struct TaskQueue : AllocatorAware
 {
     struct PollEvent
@@ -22,6 +60,7 @@ struct TaskQueue : AllocatorAware
             Default = 0,
             BeforeSubmit,
             AfterComplete,
+            Cancelled,
             _Count,
         };
 
@@ -30,52 +69,320 @@ struct TaskQueue : AllocatorAware
         Type type;
     };
 
+    /// Called by poll for each event raised by a task. Callbacks can push and cancel tasks. Changes
+    /// made while the queue is iterating over its tasks are deferred until it's done so, e.g., a
+    /// task cancelled from a callback receives its Cancelled event after the current batch of
+    /// events. Callbacks must not poll or wait on the queue.
     using PollCallback = bool(PollEvent const& event);
 
-    TaskQueue(Allocator const alloc = {}) : queue_(alloc), pool_(alloc) {}
+    static constexpr isize max_poll_events = std::numeric_limits<isize>::max();
+    static constexpr isize max_in_flight_count = std::numeric_limits<isize>::max();
+    static constexpr isize max_in_flight_cost = std::numeric_limits<isize>::max();
 
-    TaskQueue(TaskQueue&& other) noexcept = default;
-    TaskQueue& operator=(TaskQueue&& other) = default;
+    TaskQueue(Allocator const alloc = {}) :
+        queue_(alloc),
+        completed_(alloc),
+        ready_(alloc),
+        pool_(alloc),
+        to_submit_(alloc),
+        timers_(alloc),
+        deferred_(alloc),
+        deferred_cancels_(alloc)
+    {
+    }
+
+    /// Creates a queue that submits tasks to the given thread pool instead of the default one
+    TaskQueue(WorkerPool& thread_pool, Allocator const alloc = {}) : TaskQueue(alloc)
+    {
+        thread_pool_ = &thread_pool;
+    }
+
+    /// Moved-from queues are left empty and can still be used
+    TaskQueue(TaskQueue&& other) noexcept;
+
+    /// Takes over the other queue's tasks. Any tasks left in this queue are cancelled and waited on
+    /// first, invalidating their handles, and any futures referring to them must have been reset.
+    /// Tasks are referenced by address so both queues must use the same allocator.
+    TaskQueue& operator=(TaskQueue&& other);
+
+    ~TaskQueue();
 
     /// Returns the allocator used by this container
     Allocator allocator() const { return queue_.get_allocator(); }
 
+    /// Returns the thread pool that tasks are submitted to
+    WorkerPool& thread_pool() const
+    {
+        return (thread_pool_) ? *thread_pool_ : ThreadPool::instance();
+    }
+
     /// Pushes a task onto the queue for deferred asynchronous execution. The calling context is
-    /// responsible for keeping the task alive until completion.
-    void push(TaskRef const& task, void* context = nullptr, PollCallback* poll_cb = nullptr);
+    /// responsible for keeping the task alive until completion. The cost counts against the
+    /// queue's in-flight cost limit (e.g. the size of the task's buffers). Returns a handle that
+    /// can be used to check on this task specifically.
+    TaskHandle push(
+        TaskRef const& task,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
+
+    /// Pushes a task that won't be submitted until the tasks referenced by the given handles are
+    /// done. Unlike a barrier, this only holds back the pushed task so independent chains of tasks
+    /// can proceed concurrently. Cancelled dependencies count as done. Delayed tasks that aren't
+    /// due yet and periodic tasks can't be dependencies since they'd be queued behind any barrier
+    /// inserted after the dependent, leaving both stuck. If any of the given dependencies is such
+    /// a task, nothing is pushed and an invalid handle is returned. See push for details.
+    TaskHandle push(
+        TaskRef const& task,
+        Span<TaskHandle const> const& dependencies,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
+
+    /// Pushes a task owned by the queue. The task is destroyed once it's been handled by poll or
+    /// cancelled. Poll events for the task refer to the owned instance. See push for details.
+    TaskHandle push(
+        UniqueTask&& task,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
+
+    /// Pushes a task owned by the queue that won't be submitted until the given dependencies are
+    /// done. See push for details.
+    TaskHandle push(
+        UniqueTask&& task,
+        Span<TaskHandle const> const& dependencies,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
+
+    /// Pushes a task onto the queue from any thread. This lets tasks queue follow-up work directly
+    /// instead of going through the polling thread. Tasks are picked up by the next poll in the
+    /// order they were pushed and are only counted by size from then on. See push for details.
+    TaskHandle push_concurrent(
+        TaskRef const& task,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
+
+    /// Pushes a task owned by the queue from any thread. See push_concurrent for details.
+    TaskHandle push_concurrent(
+        UniqueTask&& task,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
+
+    /// Pushes a task that's queued once the current time reaches the given time (see set_time).
+    /// Scheduled tasks cost nothing until they're due and aren't counted by size until then. The
+    /// returned handle can't be used as a dependency until the task is due. See push for details.
+    TaskHandle push_at(
+        TaskRef const& task,
+        u64 time,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
+
+    /// Pushes a task that's queued every period, starting one period after the current time. Each
+    /// run is scheduled once the previous one has been handled by poll, skipping any periods that
+    /// were missed in the meantime. The task repeats until cancelled so its handle isn't done until
+    /// then and can't be used as a dependency. See push_at for details.
+    TaskHandle push_periodic(
+        TaskRef const& task,
+        u64 period,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
+
+    /// Sets the current time in ticks (e.g. App::time()). Delayed and periodic tasks are queued by
+    /// poll once the current time reaches their due time so this should be called before polling.
+    void set_time(u64 const time) { time_ = time; }
+
+    /// Returns the current time in ticks
+    u64 time() const { return time_; }
+
+    /// Raises an AfterComplete event with the given context on the polling thread during the next
+    /// poll without running a task. Can be called from any thread. This is useful for handing work
+    /// back to the polling thread (e.g. resuming a coroutine). The event's task pointer is null.
+    /// Posted events count against the poll budget and can be cancelled like tasks in flight.
+    TaskHandle post(void* context, PollCallback* poll_cb);
+
+    /// Pushes a task that returns a result. The result is stored in the task's slot next to the
+    /// function object so neither needs a separate allocation if both fit in UniqueTask's inline
+    /// buffer. The result is accessed through the returned future once the task is done and the
+    /// slot is held until the future is reset. See push for details.
+    template <typename Fn, typename T = std::invoke_result_t<std::decay_t<Fn>&>>
+    TaskFuture<T> push_result(
+        Fn&& fn,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1)
+    {
+        return push_result(std::forward<Fn>(fn), {}, context, poll_cb, priority, cost);
+    }
+
+    /// Pushes a task that returns a result and won't be submitted until the given dependencies are
+    /// done. Returns an invalid future if the dependencies are rejected (see push). See
+    /// push_result for details.
+    template <typename Fn, typename T = std::invoke_result_t<std::decay_t<Fn>&>>
+    TaskFuture<T> push_result(
+        Fn&& fn,
+        Span<TaskHandle const> const& dependencies,
+        void* context = nullptr,
+        PollCallback* poll_cb = nullptr,
+        WorkerPool::Priority priority = WorkerPool::Priority_Normal,
+        isize cost = 1);
 
     /// Inserts a barrier. Tasks queued after inserting a barrier won't start until all
     /// previously queued tasks have completed.
-    void barrier() { queue_.push_back(nullptr); }
+    void barrier() { enqueue(nullptr); }
 
     /// Polls tasks in the queue. This should be called at regular intervals (e.g. every frame).
+    /// Only tasks that have completed since the last poll or are waiting to be submitted are
+    /// visited so the cost doesn't grow with the number of tasks in flight. AfterComplete events
+    /// are raised in the order tasks completed, not the order they were pushed. Use dependencies or
+    /// barriers if completion callbacks need to run in a particular order.
     void poll();
 
-    /// Returns the number of tasks in the queue
-    isize size() const { return static_cast<isize>(queue_.size()); }
+    /// Polls tasks in the queue, handling completed tasks until either the given time budget (in
+    /// nanoseconds) is spent or the given number of completion events have been raised. Remaining
+    /// events are deferred to later polls in the order they would've been raised. This is useful
+    /// for spreading expensive completion callbacks (e.g. GPU uploads) across frames. At least one
+    /// event is raised per call to ensure progress.
+    void poll(u64 max_time, isize max_events = max_poll_events);
+
+    /// Cancels all tasks in the queue that were pushed with the given context. Tasks that haven't
+    /// been submitted yet are removed immediately. Tasks that have been submitted won't be run if
+    /// they haven't started yet. Otherwise, they're expected to stop early by checking their
+    /// cancel token. In either case, the poll callback receives a Cancelled event in place of
+    /// AfterComplete. The return value of the callback is ignored for Cancelled events.
+    void cancel(void* context);
+
+    /// Cancels all tasks in the queue. See cancel for details.
+    void cancel_all();
+
+    /// Returns a token for the queued task running on the calling thread. If the calling thread
+    /// isn't running a queued task, the returned token is invalid. The token must not be used
+    /// after the task completes.
+    static CancelToken cancel_token();
+
+    /// Polls until the queue is empty. The calling thread runs pending tasks from the thread pool
+    /// while it waits.
+    void wait();
+
+    /// Limits the number of tasks in flight (i.e. submitted but not yet handled by poll) along with
+    /// their total cost. Queued tasks are only submitted as capacity frees up, in the order they
+    /// were pushed. A task that exceeds the cost limit on its own is submitted once nothing else is
+    /// in flight. Unlimited by default.
+    void set_max_in_flight(isize max_count, isize max_cost = max_in_flight_cost);
+
+    /// Returns true if the task referenced by the given handle is done i.e. it's been handled by
+    /// poll after completing or being cancelled. The handle stays safe to use afterwards.
+    bool is_done(TaskHandle const& handle) const;
+
+    /// Polls until the task referenced by the given handle is done. Periodic tasks are never done
+    /// until cancelled so for those, this only waits until the current run (if any) has been
+    /// handled by poll. The calling thread runs pending tasks from the thread pool while it waits.
+    void wait(TaskHandle const& handle);
+
+    /// Returns the number of tasks in flight
+    isize num_in_flight() const { return num_submitted_; }
+
+    /// Returns the total cost of tasks in flight
+    isize in_flight_cost() const { return in_flight_cost_; }
+
+    /// Returns the number of delayed and periodic tasks that aren't due yet
+    isize num_scheduled() const { return static_cast<isize>(timers_.size()); }
+
+    /// Returns the number of tasks in the queue (including barriers and tasks in flight)
+    isize size() const
+    {
+        return static_cast<isize>(queue_.size()) + num_submitted_ + num_waiting_;
+    }
+
+#ifdef DR_APP_TASK_STATS
+    struct Stats
+    {
+        DurationHistogram queued; // Time from push to submission
+        DurationHistogram submitted; // Time from submission to start
+        DurationHistogram running; // Time from start to completion
+        DurationHistogram completed; // Time from completion to being handled by poll
+        isize max_size; // Peak number of tasks in the queue
+    };
+
+    /// Returns stats collected since construction or the last reset
+    Stats const& stats() const { return stats_; }
+
+    /// Resets all stats
+    void reset_stats() { stats_ = {}; }
+#endif
 
   private:
-    struct Task
+    struct TaskList;
+    struct Dependent;
+    struct Shared;
+
+#ifdef DR_APP_TASK_QUEUE_PACKED
+    // NOTE: Baseline layout without cache line padding. Only used to measure its effect.
+    static constexpr isize task_alignment = alignof(std::max_align_t);
+#else
+    static constexpr isize task_alignment = 64;
+#endif
+
+    /// NOTE: Tasks are aligned to cache lines since workers write to their status on completion.
+    /// This keeps workers from invalidating lines that hold other tasks.
+    struct alignas(task_alignment) Task
     {
         enum Status : u8
         {
             Status_Queued = 0,
+            Status_Scheduled,
+            Status_Waiting,
             Status_Submitted,
             Status_Completed,
+            Status_Held, // Handled by poll but kept for its result
             _Status_Count,
         };
 
         TaskRef ref;
+        UniqueTask owned; // Referenced by ref when the queue owns the task
         void* context;
         PollCallback* poll_cb;
+        WorkerPool::Priority priority;
+        isize cost;
+        u64 due_time; // Time at which a delayed or periodic task is queued
+        u64 period; // Time between runs of a periodic task
+        u32 generation;
+        isize num_dependencies; // Dependencies that aren't done yet
+        Dependent* dependents; // Tasks that depend on this one
         std::atomic<Status> status;
+        std::atomic<bool> is_cancelled;
+        TaskList* completions;
+        Task* next;
+        void* result; // Result storage for tasks pushed via push_result
+        bool is_concurrent; // Pushed via push_concurrent
+        bool is_held; // Slot is kept after poll until the result is released
 
-        /// Invokes the referenced task
-        void operator()()
+#ifdef DR_APP_TASK_STATS
+        struct
         {
-            ref();
-            status.store(Status_Completed);
-        }
+            u64 push;
+            u64 submit;
+            u64 start;
+            u64 complete;
+        } times;
+#endif
+
+        /// Invokes the referenced task unless it's been cancelled
+        void operator()();
 
         /// Fires poll callback
         bool raise_event(PollEvent::Type const type)
@@ -84,23 +391,336 @@ struct TaskQueue : AllocatorAware
         }
     };
 
+    /// Lock-free list of tasks. Any thread can push tasks while poll takes the whole list at once.
+    struct alignas(task_alignment) TaskList
+    {
+        std::atomic<Task*> head{};
+
+        /// Adds a task to the list. Can be called from any thread.
+        void push(Task* task);
+
+        /// Removes all tasks from the list, returning them in the order they were pushed
+        Task* take_all();
+    };
+
+    /// Storage for the result of a task pushed via push_result
+    template <typename T>
+    struct Result
+    {
+        alignas(T) std::byte value[sizeof(T)];
+        bool has_value{};
+
+        Result() = default;
+
+        Result(Result&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        {
+            if (other.has_value)
+            {
+                ::new (static_cast<void*>(value)) T(std::move(*other.get()));
+                has_value = true;
+            }
+        }
+
+        ~Result()
+        {
+            if (has_value)
+                get()->~T();
+        }
+
+        T* get() { return std::launder(reinterpret_cast<T*>(value)); }
+    };
+
+    /// Task that stores the result of a function object
+    template <typename Fn, typename T>
+    struct ResultTask
+    {
+        Result<T> result;
+        Fn fn;
+
+        void operator()()
+        {
+            // NOTE: Result is constructed in place from the returned value
+            ::new (static_cast<void*>(result.value)) T(fn());
+            result.has_value = true;
+        }
+    };
+
+    template <typename T>
+    friend struct TaskFuture;
+
+    /// Returns the result of the given task if it has one
+    template <typename T>
+    T* get_result(TaskHandle const& handle) const
+    {
+        assert(is_done(handle));
+        Task* const task = static_cast<Task*>(handle.task_);
+        assert(task->generation == handle.generation_ && task->is_held);
+
+        // NOTE: Tasks cancelled after they ran still hold a result which is discarded on reset
+        Result<T>* const result = static_cast<Result<T>*>(task->result);
+        return (result->has_value && !task->is_cancelled.load()) ? result->get() : nullptr;
+    }
+
+    void release_result(TaskHandle const& handle);
+
+    /// Entry in the min-heap of delayed and periodic tasks
+    struct Timer
+    {
+        u64 time;
+        u64 order; // Keeps tasks due at the same time in the order they were scheduled
+        Task* task;
+
+        static bool is_later(Timer const& a, Timer const& b)
+        {
+            return (a.time != b.time) ? a.time > b.time : a.order > b.order;
+        }
+    };
+
+    /// Node in a task's list of dependents
+    struct Dependent
+    {
+        Task* task;
+        u32 generation; // Nodes left behind by cancelled tasks are stale once the slot is released
+        Dependent* next;
+    };
+
+    template <typename Predicate>
+    void cancel_if(Predicate&& pred);
+
+    TaskHandle push(Task* task, Span<TaskHandle const> const& dependencies);
+
+    TaskHandle push_concurrent(Task* task);
+
+    void release_task(Task* task);
+
+    void free_task(Task* task);
+
+    void handle_completed(u64 max_time, isize max_events);
+
+    void submit_queued();
+
+    /// Returns state shared with other threads, creating it on first use. Can be called from any
+    /// thread.
+    Shared& shared();
+
+    void take_shared();
+
+    void take_intake();
+
+    void schedule(Task* task, u64 time);
+
+    void take_due();
+
+    /// Adds a task or barrier to the back of the queue
+    void enqueue(Task* task);
+
+    /// Applies changes deferred by poll callbacks (see is_iterating_)
+    void apply_deferred();
+
+    /// Slab allocator for tasks. Tasks are allocated from fixed-capacity chunks that are never
+    /// freed while the pool is alive so task addresses stay stable. Released tasks are linked
+    /// through their next pointer.
     struct TaskPool : AllocatorAware
     {
-        TaskPool(Allocator const alloc = {}) : pool_(alloc), free_(alloc) {}
+        static constexpr isize chunk_size = 64;
+
+        TaskPool(Allocator const alloc = {}) : chunks_(alloc), dependents_(alloc) {}
+
+        TaskPool(TaskPool&& other) noexcept;
 
-        TaskPool(TaskPool&& other) noexcept = default;
-        TaskPool& operator=(TaskPool&& other) = default;
+        /// Takes over the other pool's tasks. Tasks are referenced by address so the pools must
+        /// share an allocator and this pool must not have any tasks in use.
+        TaskPool& operator=(TaskPool&& other) noexcept;
 
-        Task* make(TaskRef const& ref, void* context, PollCallback* poll_cb);
+        Allocator allocator() const { return chunks_.get_allocator(); }
+
+        Task* make(
+            TaskRef const& ref,
+            void* context,
+            PollCallback* poll_cb,
+            WorkerPool::Priority priority,
+            isize cost);
         void release(Task* const task);
 
+        Dependent* make_dependent(Task* const task, Dependent* const next);
+        void release_dependent(Dependent* const dependent);
+
+        template <typename Fn>
+        void for_each(Fn&& fn)
+        {
+            // NOTE: All chunks before the last one are fully used
+            isize const num_chunks = static_cast<isize>(chunks_.size());
+            for (isize i = 0; i < num_chunks; ++i)
+            {
+                isize const n = (i + 1 < num_chunks) ? chunk_size : num_used_;
+                for (isize j = 0; j < n; ++j)
+                    fn(chunks_[i].tasks[j]);
+            }
+        }
+
       private:
-        Deque<Task> pool_;
-        DynamicArray<Task*> free_;
+        struct Chunk
+        {
+            Task tasks[chunk_size];
+        };
+
+        Deque<Chunk> chunks_;
+        isize num_used_{chunk_size}; // Tasks used in the last chunk
+        isize num_live_{}; // Tasks made but not yet released
+        Task* free_{};
+        Deque<Dependent> dependents_;
+        Dependent* free_dependents_{};
+    };
+
+    /// State shared with other threads
+    struct Shared
+    {
+        TaskList completed;
+        TaskList intake;
+        TaskPool pool; // Tasks pushed via push_concurrent
+        std::mutex mutex;
+
+        Shared(Allocator const alloc) : pool(alloc) {}
     };
 
-    Deque<Task*> queue_;
+    Deque<Task*> queue_; // Tasks and barriers waiting to be submitted
+    Deque<Task*> completed_; // Completed tasks that haven't been handled yet
+    Deque<Task*> ready_; // Tasks set aside until their dependencies were done
     TaskPool pool_;
+    DynamicArray<TaskRef> to_submit_;
+    DynamicArray<Timer> timers_; // Delayed and periodic tasks that aren't due yet
+    u64 time_{};
+    u64 num_timers_{}; // Timers scheduled so far
+    isize num_submitted_{}; // Tasks submitted but not yet handled
+    isize num_waiting_{}; // Tasks set aside until their dependencies are done
+    isize in_flight_cost_{};
+    isize max_in_flight_{max_in_flight_count};
+    isize max_in_flight_cost_{max_in_flight_cost};
+
+    // Changes made by poll callbacks while the queue is iterating over its tasks are deferred
+    // until it's done
+    bool is_iterating_{};
+    Deque<Task*> deferred_; // Tasks and barriers pushed or scheduled by poll callbacks
+    DynamicArray<void*> deferred_cancels_; // Contexts cancelled by poll callbacks
+    bool is_cancel_all_deferred_{};
+    std::atomic<Shared*> shared_{}; // Created on first use (see shared)
+    WorkerPool* thread_pool_{};
+
+#ifdef DR_APP_TASK_STATS
+    Stats stats_{};
+#endif
 };
 
+/// Refers to the result of a task pushed via TaskQueue::push_result. Only used on the thread that
+/// polls the queue. The queue must outlive the future and can't be moved while it's in use.
+template <typename T>
+struct TaskFuture
+{
+    TaskFuture() = default;
+
+    TaskFuture(TaskFuture&& other) noexcept :
+        queue_{std::exchange(other.queue_, nullptr)},
+        handle_{std::exchange(other.handle_, {})}
+    {
+    }
+
+    TaskFuture& operator=(TaskFuture&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            queue_ = std::exchange(other.queue_, nullptr);
+            handle_ = std::exchange(other.handle_, {});
+        }
+
+        return *this;
+    }
+
+    TaskFuture(TaskFuture const& other) = delete;
+    TaskFuture& operator=(TaskFuture const& other) = delete;
+
+    ~TaskFuture() { reset(); }
+
+    /// Returns a handle to the task. This stays valid after the future is reset.
+    TaskHandle const& handle() const { return handle_; }
+
+    /// Returns true if the future refers to a task
+    bool is_valid() const { return queue_ != nullptr; }
+    explicit operator bool() const { return is_valid(); }
+
+    /// Returns true if the task is done i.e. it's been handled by poll after completing or being
+    /// cancelled
+    bool is_ready() const
+    {
+        assert(is_valid());
+        return queue_->is_done(handle_);
+    }
+
+    /// Polls the queue until the task is done. See TaskQueue::wait for details.
+    void wait()
+    {
+        assert(is_valid());
+        queue_->wait(handle_);
+    }
+
+    /// Returns the result of the task or nullptr if it was cancelled (i.e. its poll callback
+    /// received a Cancelled event), even if it ran to completion. The task must be done.
+    T* get() const
+    {
+        assert(is_valid());
+        return queue_->template get_result<T>(handle_);
+    }
+
+    /// Releases the task's slot along with its result
+    void reset()
+    {
+        if (queue_ != nullptr)
+        {
+            queue_->release_result(handle_);
+            queue_ = nullptr;
+        }
+    }
+
+  private:
+    TaskQueue* queue_{};
+    TaskHandle handle_{};
+
+    TaskFuture(TaskQueue* const queue, TaskHandle const& handle) : queue_{queue}, handle_{handle}
+    {
+    }
+
+    friend struct TaskQueue;
+};
+
+template <typename Fn, typename T>
+TaskFuture<T> TaskQueue::push_result(
+    Fn&& fn,
+    Span<TaskHandle const> const& dependencies,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
+{
+    static_assert(!std::is_void_v<T>, "Use push for tasks that don't return a result");
+
+    using Owned = ResultTask<std::decay_t<Fn>, T>;
+
+    TaskHandle const handle = push(
+        Owned{{}, std::forward<Fn>(fn)},
+        dependencies,
+        context,
+        poll_cb,
+        priority,
+        cost);
+
+    if (!handle.is_valid())
+        return {};
+
+    Task* const task = static_cast<Task*>(handle.task_);
+    task->result = &static_cast<Owned*>(task->owned.get())->result;
+    task->is_held = true;
+
+    return {this, handle};
+}
+
 } // namespace dr
\ No newline at end of file
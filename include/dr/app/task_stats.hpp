@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+    Timing statistics for WorkerPool and TaskQueue. Collection is only compiled in when
+    DR_APP_TASK_STATS is defined (see the corresponding CMake option) so release builds pay nothing
+    for it.
+*/
+
+#include <dr/basic_types.hpp>
+
+namespace dr
+{
+
+/// Histogram of durations in nanoseconds with power-of-two bucket widths
+struct DurationHistogram
+{
+    static constexpr isize num_buckets = 48;
+
+    u64 counts[num_buckets]{};
+    u64 count{};
+    u64 total{};
+    u64 max{};
+
+    /// Adds a duration to the histogram
+    void add(u64 duration);
+
+    /// Adds the contents of another histogram to this one
+    void merge(DurationHistogram const& other);
+
+    /// Returns the mean duration
+    u64 mean() const { return (count > 0) ? total / count : 0; }
+
+    /// Returns an upper bound on the duration at the given percentile in [0, 1]
+    u64 percentile(f64 p) const;
+};
+
+/// Returns the current time in nanoseconds from a monotonic clock
+u64 task_stats_now();
+
+} // namespace dr
@@ -1,23 +1,365 @@
 #pragma once
 
 /*
-    Simple global thread pool for doing work off the main thread
+    Simple thread pool for doing work off the main thread. ThreadPool provides static access to a
+    default instance while separate instances can be created for specific kinds of work (e.g. a
+    small pool for blocking I/O alongside a compute pool).
+
+    Each worker owns a work-stealing deque. Tasks submitted from a worker are pushed onto its own
+    deque while tasks submitted from other threads go through a shared injection queue. Idle
+    workers steal from their peers.
+
+    Tasks can be submitted with a priority. High priority tasks are taken before anything else while
+    low priority tasks are only run by a limited number of workers at once. This keeps bursts of
+    background work from starving latency-sensitive tasks.
 */
 
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <dr/allocator.hpp>
 #include <dr/basic_types.hpp>
+#include <dr/dynamic_array.hpp>
+#include <dr/span.hpp>
 
 #include <dr/app/task_ref.hpp>
+#include <dr/app/task_stats.hpp>
+#include <dr/app/unique_task.hpp>
 
 namespace dr
 {
 
+struct WorkerPool : AllocatorAware
+{
+    enum Priority : u8
+    {
+        Priority_High = 0,
+        Priority_Normal,
+        Priority_Low,
+        _Priority_Count,
+    };
+
+    enum Affinity : u8
+    {
+        Affinity_None = 0, // Workers can run on any CPU
+        Affinity_PhysicalCores, // Each worker is pinned to its own physical core
+        Affinity_CpuSet, // Workers can run on any CPU in a given set
+        _Affinity_Count,
+    };
+
+    /// Max number of workers in a single pool
+    static constexpr isize max_workers = 256;
+
+    WorkerPool(Allocator alloc = {});
+    ~WorkerPool();
+
+    WorkerPool(WorkerPool const& other) = delete;
+    WorkerPool& operator=(WorkerPool const& other) = delete;
+
+    /// Returns the allocator used by this container
+    Allocator allocator() const;
+
+    /// Starts the given number of workers. If the pool is already active, it's resized instead.
+    /// With zero workers, the pool runs in inline mode where tasks are run on the submitting thread
+    /// in submission order. This is useful for debugging and single-threaded profiling.
+    void start(isize num_workers);
+
+    /// Starts the default number of workers (see default_num_workers)
+    void start();
+
+    /// Changes the number of active workers without waiting on pending tasks. Surplus workers are
+    /// retired once they finish their current task and are reused if the pool grows again. Resizing
+    /// to zero switches the pool to inline mode (see start) and runs any queued tasks on the
+    /// calling thread.
+    void resize(isize num_workers);
+
+    /// Stops all workers after any remaining tasks have completed
+    void stop();
+
+    /// Submits a task for asynchronous execution. The calling context is responsible for keeping
+    /// the task alive until completion.
+    void submit(TaskRef const& task, Priority priority = Priority_Normal);
+
+    /// Submits a batch of tasks for asynchronous execution. This is cheaper than submitting each
+    /// task individually since the batch is queued under a single lock and idle workers are woken
+    /// all at once.
+    void submit(Span<TaskRef const> const& tasks, Priority priority = Priority_Normal);
+
+    /// Submits a task owned by the pool. The task is stored in a slot that's recycled once the
+    /// task has run so submitting doesn't allocate once the pool has warmed up. Workers recycle
+    /// slots through their own free lists so they don't contend on submission or completion.
+    void submit(UniqueTask&& task, Priority priority = Priority_Normal);
+
+    /// Sets the max number of workers that can run low priority tasks at once. Defaults to all but
+    /// one of the active workers. An explicit limit is kept when the pool is resized but is clamped
+    /// to the number of active workers.
+    void set_max_low_priority_workers(isize count);
+
+    /// Returns the max number of workers that can run low priority tasks at once
+    isize max_low_priority_workers() const;
+
+    /// Sets how worker threads are assigned to CPUs. With Affinity_PhysicalCores, workers are
+    /// pinned to separate physical cores (skipping SMT siblings and preferring performance cores on
+    /// hybrid CPUs), limited to the given CPUs if any. With Affinity_CpuSet, workers can run on any
+    /// of the given CPUs. Only applies to workers created after the call so this should be called
+    /// before start. Currently only supported on Linux.
+    void set_affinity(Affinity affinity, Span<i32 const> const& cpus = {});
+
+    /// Sets the name given to worker threads. Each thread is named after the pool followed by its
+    /// index (e.g. "dr-worker-0"). Only applies to workers created after the call.
+    void set_name(char const* name);
+
+    /// Sets the number of times an idle worker checks for new work before parking. Spinning cuts
+    /// the latency of tasks submitted to an idle pool at the cost of CPU time. Set to 0 to park
+    /// immediately.
+    void set_spin_count(isize count);
+
+    /// Returns the number of active workers. This is zero in inline mode.
+    isize num_workers() const;
+
+    /// Returns the number of physical cores available to the process. Falls back to the number of
+    /// hardware threads if core topology isn't available.
+    static isize num_physical_cores();
+
+    /// Returns the number of workers started by default. This is one per physical core, leaving
+    /// one for the calling thread.
+    static isize default_num_workers();
+
+    /// Runs a pending task on the calling thread if one is available. Returns true if a task was
+    /// run.
+    bool run_pending_task();
+
+    /// Returns an allocator for temporary memory owned by the calling worker. Memory is released
+    /// in bulk once the current task completes so it must not outlive the task. If the calling
+    /// thread isn't a worker, the default allocator is returned instead.
+    static Allocator scratch_allocator();
+
+#ifdef DR_APP_TASK_STATS
+    struct Stats
+    {
+        isize num_queued; // Tasks waiting in injection queues and worker deques
+        isize num_sleeping; // Workers currently parked
+        u64 elapsed_time; // Nanoseconds since start or last reset
+    };
+
+    struct WorkerStats
+    {
+        u64 num_tasks; // Tasks run by the worker
+        u64 num_steals; // Tasks stolen from other workers
+        u64 busy_time; // Nanoseconds spent running tasks
+        f64 utilization; // Fraction of elapsed time spent running tasks
+    };
+
+    /// Returns a snapshot of pool-wide stats
+    Stats stats() const;
+
+    /// Returns a snapshot of stats for the worker at the given index
+    WorkerStats worker_stats(isize index) const;
+
+    /// Resets all stats. This is also done on start.
+    void reset_stats();
+#endif
+
+    /// Runs pending tasks on the calling thread while the given predicate returns true. This lets
+    /// the caller contribute to the pool instead of idling while it waits on some condition.
+    template <typename Predicate>
+    void help_while(Predicate&& pred)
+    {
+        static_assert(std::is_invocable_r_v<bool, Predicate>);
+
+        while (pred())
+        {
+            if (!run_pending_task())
+                std::this_thread::yield();
+        }
+    }
+
+    /// Calls the given function over subranges of [begin, end) in parallel. Subranges are claimed
+    /// dynamically, starting large and shrinking towards the given grain size as the range is
+    /// consumed. The calling thread participates and returns once the entire range has been
+    /// processed.
+    template <typename Fn>
+    void parallel_for(isize const begin, isize const end, isize const grain, Fn&& fn)
+    {
+        static_assert(std::is_invocable_v<Fn, isize, isize>);
+
+        auto const body = [&](isize /*participant*/, isize const i0, isize const i1) -> void {
+            fn(i0, i1);
+        };
+
+        parallel_for(begin, end, grain, 1 + num_workers(), &body);
+    }
+
+    /// Maps subranges of [begin, end) to values in parallel and reduces the results. Each
+    /// participating thread starts from the given identity value so the reduction is expected to
+    /// be associative and commutative.
+    template <typename T, typename Map, typename Reduce>
+    T parallel_reduce(
+        isize const begin,
+        isize const end,
+        isize const grain,
+        T const& identity,
+        Map&& map,
+        Reduce&& reduce)
+    {
+        static_assert(std::is_invocable_r_v<T, Map, isize, isize>);
+        static_assert(std::is_invocable_r_v<T, Reduce, T const&, T const&>);
+
+        // Each participant accumulates into its own partial result
+        isize const max_participants = 1 + num_workers();
+        DynamicArray<Partial<T>> partials(max_participants, Partial<T>{identity});
+
+        auto const body = [&](isize const participant, isize const i0, isize const i1) -> void {
+            T& partial = partials[participant].value;
+            partial = reduce(partial, map(i0, i1));
+        };
+
+        parallel_for(begin, end, grain, max_participants, &body);
+
+        T result = partials[0].value;
+        for (isize i = 1; i < max_participants; ++i)
+            result = reduce(result, partials[i].value);
+
+        return result;
+    }
+
+  private:
+    static constexpr isize cache_line_size = 64;
+
+    /// Partial result of parallel_reduce. Each one gets its own cache line so participants don't
+    /// contend on each other's writes.
+    template <typename T>
+    struct alignas(cache_line_size) Partial
+    {
+        T value;
+    };
+
+    /// Type-erased reference to a function object called over subranges by participating threads
+    struct RangeFnRef
+    {
+        template <typename Src>
+        RangeFnRef(Src* const src) :
+            ptr_{const_cast<void*>(static_cast<void const*>(src))},
+            invoke_{[](void* ptr, isize const participant, isize const i0, isize const i1) {
+                (*static_cast<Src*>(ptr))(participant, i0, i1);
+            }}
+        {
+        }
+
+        void operator()(isize const participant, isize const i0, isize const i1) const
+        {
+            invoke_(ptr_, participant, i0, i1);
+        }
+
+      private:
+        void* ptr_;
+        void (*invoke_)(void*, isize, isize, isize);
+    };
+
+    struct State;
+
+    void parallel_for(
+        isize begin,
+        isize end,
+        isize grain,
+        isize max_participants,
+        RangeFnRef const& fn);
+
+    std::unique_ptr<State> state_;
+};
+
+/// Static interface to the default pool instance. See WorkerPool for details.
 struct ThreadPool
 {
-    static void start(isize num_workers);
+    using Priority = WorkerPool::Priority;
+
+    /// Returns the default pool instance
+    static WorkerPool& instance();
+
+    static void start(isize const num_workers) { instance().start(num_workers); }
+
+    static void start() { instance().start(); }
+
+    static void resize(isize const num_workers) { instance().resize(num_workers); }
+
+    static void stop() { instance().stop(); }
+
+    static void submit(TaskRef const& task, Priority const priority = WorkerPool::Priority_Normal)
+    {
+        instance().submit(task, priority);
+    }
+
+    static void submit(
+        Span<TaskRef const> const& tasks,
+        Priority const priority = WorkerPool::Priority_Normal)
+    {
+        instance().submit(tasks, priority);
+    }
+
+    static void submit(UniqueTask&& task, Priority const priority = WorkerPool::Priority_Normal)
+    {
+        instance().submit(std::move(task), priority);
+    }
+
+    static void set_max_low_priority_workers(isize const count)
+    {
+        instance().set_max_low_priority_workers(count);
+    }
+
+    static isize max_low_priority_workers() { return instance().max_low_priority_workers(); }
+
+    static void set_affinity(
+        WorkerPool::Affinity const affinity,
+        Span<i32 const> const& cpus = {})
+    {
+        instance().set_affinity(affinity, cpus);
+    }
+
+    static void set_name(char const* const name) { instance().set_name(name); }
+
+    static void set_spin_count(isize const count) { instance().set_spin_count(count); }
+
+    static isize num_workers() { return instance().num_workers(); }
+
+    static isize num_physical_cores() { return WorkerPool::num_physical_cores(); }
+
+    static isize default_num_workers() { return WorkerPool::default_num_workers(); }
+
+    static bool run_pending_task() { return instance().run_pending_task(); }
+
+    static Allocator scratch_allocator() { return WorkerPool::scratch_allocator(); }
+
+    template <typename Predicate>
+    static void help_while(Predicate&& pred)
+    {
+        instance().help_while(std::forward<Predicate>(pred));
+    }
 
-    static void stop();
+    template <typename Fn>
+    static void parallel_for(isize const begin, isize const end, isize const grain, Fn&& fn)
+    {
+        instance().parallel_for(begin, end, grain, std::forward<Fn>(fn));
+    }
 
-    static void submit(TaskRef const& task);
+    template <typename T, typename Map, typename Reduce>
+    static T parallel_reduce(
+        isize const begin,
+        isize const end,
+        isize const grain,
+        T const& identity,
+        Map&& map,
+        Reduce&& reduce)
+    {
+        return instance().parallel_reduce(
+            begin,
+            end,
+            grain,
+            identity,
+            std::forward<Map>(map),
+            std::forward<Reduce>(reduce));
+    }
 };
 
 } // namespace dr
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <dr/basic_types.hpp>
+
+namespace dr
+{
+
+/// Owning counterpart to TaskRef. Function objects that fit the inline buffer (e.g. a lambda
+/// capturing a path and a few pointers) are stored in place so creating a task doesn't allocate.
+/// Larger function objects are moved to the heap.
+struct UniqueTask
+{
+    /// Max size of function objects stored inline
+    static constexpr isize inline_size = 48;
+
+    UniqueTask() = default;
+
+    /// Creates a task from a function object
+    template <
+        typename Src,
+        typename Fn = std::decay_t<Src>,
+        typename = std::enable_if_t<
+            !std::is_same_v<Fn, UniqueTask> && std::is_invocable_r_v<void, Fn&>>>
+    UniqueTask(Src&& src)
+    {
+        if constexpr (is_inline<Fn>)
+        {
+            ::new (static_cast<void*>(storage_)) Fn(std::forward<Src>(src));
+            ops_ = &inline_ops<Fn>;
+        }
+        else
+        {
+            ::new (static_cast<void*>(storage_)) Fn*(new Fn(std::forward<Src>(src)));
+            ops_ = &heap_ops<Fn>;
+        }
+    }
+
+    UniqueTask(UniqueTask&& other) noexcept { move_from(other); }
+
+    UniqueTask& operator=(UniqueTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            move_from(other);
+        }
+
+        return *this;
+    }
+
+    UniqueTask(UniqueTask const& other) = delete;
+    UniqueTask& operator=(UniqueTask const& other) = delete;
+
+    ~UniqueTask() { reset(); }
+
+    /// Returns an opaque pointer to the owned function object
+    void* get() { return (ops_ != nullptr) ? ops_->get(storage_) : nullptr; }
+
+    /// Invokes the owned task
+    void operator()() { ops_->invoke(storage_); }
+
+    /// Returns true if the instance owns a task
+    constexpr bool is_valid() const { return ops_ != nullptr; }
+    constexpr explicit operator bool() const { return is_valid(); }
+
+    /// Destroys the owned task if any
+    void reset()
+    {
+        if (ops_ != nullptr)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+  private:
+    struct Ops
+    {
+        void (*invoke)(void*);
+        void* (*get)(void*);
+        void (*move)(void* dst, void* src); // Move constructs at dst then destroys src
+        void (*destroy)(void*);
+    };
+
+    template <typename Fn>
+    static constexpr bool is_inline = sizeof(Fn) <= inline_size
+        && alignof(Fn) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<Fn>;
+
+    template <typename Fn>
+    static constexpr Ops inline_ops{
+        [](void* ptr) { (*static_cast<Fn*>(ptr))(); },
+        [](void* ptr) -> void* { return ptr; },
+        [](void* dst, void* src) {
+            ::new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            static_cast<Fn*>(src)->~Fn();
+        },
+        [](void* ptr) { static_cast<Fn*>(ptr)->~Fn(); },
+    };
+
+    template <typename Fn>
+    static constexpr Ops heap_ops{
+        [](void* ptr) { (**static_cast<Fn**>(ptr))(); },
+        [](void* ptr) -> void* { return *static_cast<Fn**>(ptr); },
+        [](void* dst, void* src) { ::new (dst) Fn*(*static_cast<Fn**>(src)); },
+        [](void* ptr) { delete *static_cast<Fn**>(ptr); },
+    };
+
+    void move_from(UniqueTask& other)
+    {
+        if (other.ops_ != nullptr)
+        {
+            other.ops_->move(storage_, other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) std::byte storage_[inline_size];
+    Ops const* ops_{};
+};
+
+} // namespace dr
\ No newline at end of file
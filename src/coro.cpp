@@ -0,0 +1,112 @@
+#include <dr/app/coro.hpp>
+
+#include <cassert>
+#include <mutex>
+#include <new>
+
+namespace dr
+{
+namespace
+{
+
+/// Pool of fixed-size blocks for coroutine frames. Frames are grouped into size classes, each
+/// with its own free list. Blocks are carved out of chunks which are kept for the lifetime of the
+/// process since frames can be freed from any thread at any time.
+struct FramePool
+{
+    static constexpr usize block_align = 64;
+    static constexpr isize num_size_classes = 16; // Frames up to 1 KiB are pooled
+    static constexpr isize blocks_per_chunk = 32;
+
+    struct Block
+    {
+        Block* next;
+    };
+
+    struct alignas(block_align) SizeClass
+    {
+        std::mutex mutex;
+        Block* free{};
+        Block* chunks{}; // Keeps chunks reachable for leak checkers
+    };
+
+    SizeClass size_classes[num_size_classes];
+
+    static isize get_size_class(usize const size) { return (size - 1) / block_align; }
+
+    void* alloc(usize const size)
+    {
+        isize const index = get_size_class(size);
+        if (index >= num_size_classes)
+            return ::operator new(size);
+
+        SizeClass& size_class = size_classes[index];
+        std::scoped_lock const lock{size_class.mutex};
+
+        if (size_class.free == nullptr)
+            add_chunk(size_class, (index + 1) * block_align);
+
+        Block* const block = size_class.free;
+        size_class.free = block->next;
+        return block;
+    }
+
+    void free(void* const ptr, usize const size)
+    {
+        isize const index = get_size_class(size);
+        if (index >= num_size_classes)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+
+        SizeClass& size_class = size_classes[index];
+        std::scoped_lock const lock{size_class.mutex};
+
+        Block* const block = static_cast<Block*>(ptr);
+        block->next = size_class.free;
+        size_class.free = block;
+    }
+
+  private:
+    static void add_chunk(SizeClass& size_class, usize const block_size)
+    {
+        // NOTE: First block of each chunk links to the previous chunk
+        std::byte* const chunk = static_cast<std::byte*>(
+            ::operator new(block_size * blocks_per_chunk, std::align_val_t{block_align}));
+
+        Block* const head = reinterpret_cast<Block*>(chunk);
+        head->next = size_class.chunks;
+        size_class.chunks = head;
+
+        for (isize i = blocks_per_chunk - 1; i > 0; --i)
+        {
+            Block* const block = reinterpret_cast<Block*>(chunk + i * block_size);
+            block->next = size_class.free;
+            size_class.free = block;
+        }
+    }
+};
+
+FramePool& frame_pool()
+{
+    // NOTE: Never destroyed since frames can outlive static destruction
+    static FramePool* const pool = new FramePool{};
+    return *pool;
+}
+
+} // namespace
+
+void* alloc_coro_frame(usize const size)
+{
+    assert(size > 0);
+    return frame_pool().alloc(size);
+}
+
+void free_coro_frame(void* const ptr, usize const size)
+{
+    assert(size > 0);
+    frame_pool().free(ptr, size);
+}
+
+} // namespace dr
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include <dr/app/task_group.hpp>
+
+#include <cassert>
+
+namespace dr
+{
+namespace
+{
+
+constexpr isize has_continuation_bit = 1;
+constexpr isize task_count_unit = 2;
+
+} // namespace
+
+void TaskGroup::Node::operator()()
+{
+    task();
+    group->finish(this);
+}
+
+void TaskGroup::run(TaskRef const& task, WorkerPool::Priority const priority)
+{
+    assert(task.is_valid());
+
+    state_.fetch_add(task_count_unit, std::memory_order_relaxed);
+    thread_pool().submit(make_node(task), priority);
+}
+
+void TaskGroup::then(TaskRef const& continuation, WorkerPool::Priority const priority)
+{
+    assert(continuation.is_valid());
+    assert((state_.load() & has_continuation_bit) == 0);
+
+    continuation_ = continuation;
+    continuation_priority_ = priority;
+
+    // If there are no unfinished tasks, then submission falls to the caller
+    isize const prev = state_.fetch_or(has_continuation_bit, std::memory_order_acq_rel);
+    if (prev == 0)
+        submit_continuation();
+}
+
+void TaskGroup::wait()
+{
+    assert((state_.load() & has_continuation_bit) == 0);
+    thread_pool().help_while([this]() { return !is_idle(); });
+}
+
+TaskGroup::Node* TaskGroup::make_node(TaskRef const& task)
+{
+    std::scoped_lock const lock{mutex_};
+    Node* node{};
+
+    if (free_.empty())
+    {
+        nodes_.emplace_back();
+        node = &nodes_.back();
+    }
+    else
+    {
+        node = free_.back();
+        free_.pop_back();
+    }
+
+    node->task = task;
+    node->group = this;
+    return node;
+}
+
+void TaskGroup::finish(Node* const node)
+{
+    {
+        std::scoped_lock const lock{mutex_};
+        node->task = {};
+        free_.push_back(node);
+    }
+
+    // NOTE: The group must not be accessed after the decrement unless this was the last task and
+    // a continuation is set. Otherwise, a waiting thread may have already destroyed it.
+    isize const prev = state_.fetch_sub(task_count_unit, std::memory_order_acq_rel);
+    if (prev == (task_count_unit | has_continuation_bit))
+        submit_continuation();
+}
+
+void TaskGroup::submit_continuation()
+{
+    TaskRef const continuation = continuation_;
+    WorkerPool::Priority const priority = continuation_priority_;
+    WorkerPool& pool = thread_pool();
+    continuation_ = {};
+
+    // Reset the group before submitting since the continuation may reuse or destroy it
+    // NOTE: Members can't be accessed after this point since the group may already be gone
+    state_.store(0, std::memory_order_release);
+    pool.submit(continuation, priority);
+}
+
+} // namespace dr
@@ -1,100 +1,1020 @@
 #include <dr/app/task_queue.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <memory>
+#include <new>
+#include <utility>
 
 #include <dr/app/thread_pool.hpp>
 
 namespace dr
 {
+namespace
+{
+
+thread_local CancelToken running_task_token{};
+
+} // namespace
+
+void TaskQueue::Task::operator()()
+{
+    // Tasks cancelled before starting are skipped
+    if (!is_cancelled.load())
+    {
+        // NOTE: Previous token is restored since the calling thread may be helping from within
+        // another task
+        CancelToken const prev_token = running_task_token;
+        running_task_token = CancelToken{&is_cancelled};
+
+#ifdef DR_APP_TASK_STATS
+        times.start = task_stats_now();
+        ref();
+        times.complete = task_stats_now();
+#else
+        ref();
+#endif
+        running_task_token = prev_token;
+    }
+
+    status.store(Status_Completed);
+
+    // NOTE: The task can be released by poll as soon as it's on the list so it mustn't be touched
+    // after this
+    completions->push(this);
+}
+
+void TaskQueue::TaskList::push(Task* const task)
+{
+    Task* next = head.load(std::memory_order_relaxed);
+
+    do
+    {
+        task->next = next;
+    } while (!head.compare_exchange_weak(
+        next,
+        task,
+        std::memory_order_release,
+        std::memory_order_relaxed));
+}
+
+TaskQueue::Task* TaskQueue::TaskList::take_all()
+{
+    Task* task = head.exchange(nullptr, std::memory_order_acquire);
+
+    // Tasks are pushed onto the front of the list so reverse it
+    Task* result = nullptr;
+
+    while (task != nullptr)
+    {
+        Task* const next = task->next;
+        task->next = result;
+        result = task;
+        task = next;
+    }
+
+    return result;
+}
+
+TaskQueue::TaskQueue(TaskQueue&& other) noexcept :
+    queue_(std::move(other.queue_)),
+    completed_(std::move(other.completed_)),
+    ready_(std::move(other.ready_)),
+    pool_(std::move(other.pool_)),
+    to_submit_(std::move(other.to_submit_)),
+    timers_(std::move(other.timers_)),
+    time_{other.time_},
+    num_timers_{std::exchange(other.num_timers_, 0)},
+    num_submitted_{std::exchange(other.num_submitted_, 0)},
+    num_waiting_{std::exchange(other.num_waiting_, 0)},
+    in_flight_cost_{std::exchange(other.in_flight_cost_, 0)},
+    max_in_flight_{other.max_in_flight_},
+    max_in_flight_cost_{other.max_in_flight_cost_},
+    deferred_(std::move(other.deferred_)),
+    deferred_cancels_(std::move(other.deferred_cancels_)),
+    shared_{other.shared_.exchange(nullptr, std::memory_order_relaxed)},
+    thread_pool_{other.thread_pool_}
+#ifdef DR_APP_TASK_STATS
+    ,
+    stats_{std::exchange(other.stats_, {})}
+#endif
+{
+    // NOTE: Tasks in flight refer to the shared state so the source creates a new one once it's
+    // used again
+    other.queue_.clear();
+    other.completed_.clear();
+    other.ready_.clear();
+    other.to_submit_.clear();
+    other.timers_.clear();
+}
+
+TaskQueue::~TaskQueue() { delete shared_.load(std::memory_order_relaxed); }
 
-void TaskQueue::push(TaskRef const& task, void* const context, PollCallback* const poll_cb)
+TaskQueue& TaskQueue::operator=(TaskQueue&& other)
+{
+    assert(allocator() == other.allocator());
+
+    if (this != &other)
+    {
+        // NOTE: Tasks are referenced by address so this queue's own tasks are cancelled and drained
+        // before it takes over the other's storage (see TaskPool)
+        cancel_all();
+        wait();
+
+        queue_ = std::move(other.queue_);
+        completed_ = std::move(other.completed_);
+        ready_ = std::move(other.ready_);
+        pool_ = std::move(other.pool_);
+        timers_ = std::move(other.timers_);
+        time_ = other.time_;
+        num_timers_ = std::exchange(other.num_timers_, 0);
+        num_submitted_ = std::exchange(other.num_submitted_, 0);
+        num_waiting_ = std::exchange(other.num_waiting_, 0);
+        in_flight_cost_ = std::exchange(other.in_flight_cost_, 0);
+        max_in_flight_ = other.max_in_flight_;
+        max_in_flight_cost_ = other.max_in_flight_cost_;
+        delete shared_.exchange(other.shared_.exchange(nullptr, std::memory_order_relaxed));
+        thread_pool_ = other.thread_pool_;
+#ifdef DR_APP_TASK_STATS
+        stats_ = std::exchange(other.stats_, {});
+#endif
+
+        other.queue_.clear();
+        other.completed_.clear();
+        other.ready_.clear();
+        other.timers_.clear();
+    }
+
+    return *this;
+}
+
+TaskHandle TaskQueue::push(
+    TaskRef const& task,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
+{
+    return push(task, {}, context, poll_cb, priority, cost);
+}
+
+TaskHandle TaskQueue::push(
+    TaskRef const& task,
+    Span<TaskHandle const> const& dependencies,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
 {
     assert(task.is_valid());
-    queue_.push_back(pool_.make(task, context, poll_cb));
+    assert(cost >= 0);
+
+    return push(pool_.make(task, context, poll_cb, priority, cost), dependencies);
 }
 
-void TaskQueue::poll()
+TaskHandle TaskQueue::push(
+    UniqueTask&& task,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
 {
-    // Early out if queue is empty
-    if (queue_.empty())
+    return push(std::move(task), {}, context, poll_cb, priority, cost);
+}
+
+TaskHandle TaskQueue::push(
+    UniqueTask&& task,
+    Span<TaskHandle const> const& dependencies,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
+{
+    assert(task.is_valid());
+    assert(cost >= 0);
+
+    Task* const entry = pool_.make({}, context, poll_cb, priority, cost);
+    entry->owned = std::move(task);
+    entry->ref = &entry->owned;
+
+    return push(entry, dependencies);
+}
+
+TaskHandle TaskQueue::push(Task* const entry, Span<TaskHandle const> const& dependencies)
+{
+    entry->completions = &shared().completed;
+
+    // NOTE: Tasks pushed from other threads are collected first so any dependencies among them are
+    // queued ahead of this task. Otherwise they could end up behind a barrier that's waiting on
+    // this task.
+    if (dependencies.size() > 0)
+        take_intake();
+
+    // Scheduled tasks are queued once due which could be behind a barrier that's waiting on this
+    // task so they're rejected as dependencies
+    for (TaskHandle const& dep : dependencies)
+    {
+        if (dep.is_valid() && !is_done(dep))
+        {
+            Task const* const dep_task = static_cast<Task const*>(dep.task_);
+
+            if (dep_task->status.load() == Task::Status_Scheduled || dep_task->period > 0)
+            {
+                free_task(entry);
+                return {};
+            }
+        }
+    }
+
+    // Link the task to any dependencies that aren't done yet
+    for (TaskHandle const& dep : dependencies)
+    {
+        if (dep.is_valid() && !is_done(dep))
+        {
+            Task* const dep_task = static_cast<Task*>(dep.task_);
+            dep_task->dependents = pool_.make_dependent(entry, dep_task->dependents);
+            ++entry->num_dependencies;
+        }
+    }
+
+    enqueue(entry);
+
+#ifdef DR_APP_TASK_STATS
+    entry->times.push = task_stats_now();
+    stats_.max_size = std::max(stats_.max_size, size());
+#endif
+
+    return {entry, entry->generation};
+}
+
+TaskHandle TaskQueue::push_concurrent(
+    TaskRef const& task,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
+{
+    assert(task.is_valid());
+    assert(cost >= 0);
+
+    Shared& state = shared();
+    Task* entry{};
+    {
+        std::scoped_lock const lock{state.mutex};
+        entry = state.pool.make(task, context, poll_cb, priority, cost);
+    }
+
+    return push_concurrent(entry);
+}
+
+TaskHandle TaskQueue::push_concurrent(
+    UniqueTask&& task,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
+{
+    assert(task.is_valid());
+    assert(cost >= 0);
+
+    Shared& state = shared();
+    Task* entry{};
+    {
+        std::scoped_lock const lock{state.mutex};
+        entry = state.pool.make({}, context, poll_cb, priority, cost);
+    }
+
+    // NOTE: Task isn't visible to other threads until it's pushed onto the intake list
+    entry->owned = std::move(task);
+    entry->ref = &entry->owned;
+
+    return push_concurrent(entry);
+}
+
+TaskHandle TaskQueue::push_concurrent(Task* const entry)
+{
+    Shared& state = shared();
+    entry->completions = &state.completed;
+    entry->is_concurrent = true;
+
+#ifdef DR_APP_TASK_STATS
+    entry->times.push = task_stats_now();
+#endif
+
+    // NOTE: Handle is created before the task is visible to poll
+    TaskHandle const handle{entry, entry->generation};
+    state.intake.push(entry);
+    return handle;
+}
+
+TaskHandle TaskQueue::push_at(
+    TaskRef const& task,
+    u64 const time,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
+{
+    assert(task.is_valid());
+    assert(cost >= 0);
+
+    Task* const entry = pool_.make(task, context, poll_cb, priority, cost);
+    entry->completions = &shared().completed;
+    schedule(entry, time);
+
+    return {entry, entry->generation};
+}
+
+TaskHandle TaskQueue::push_periodic(
+    TaskRef const& task,
+    u64 const period,
+    void* const context,
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
+{
+    assert(task.is_valid());
+    assert(period > 0);
+    assert(cost >= 0);
+
+    Task* const entry = pool_.make(task, context, poll_cb, priority, cost);
+    entry->completions = &shared().completed;
+    entry->period = period;
+    schedule(entry, time_ + period);
+
+    return {entry, entry->generation};
+}
+
+void TaskQueue::schedule(Task* const task, u64 const time)
+{
+    task->due_time = time;
+    task->status.store(Task::Status_Scheduled);
+
+    if (is_iterating_)
+    {
+        deferred_.push_back(task);
         return;
+    }
+
+    timers_.push_back({time, num_timers_++, task});
+    std::push_heap(timers_.begin(), timers_.end(), Timer::is_later);
+}
 
-    isize batch_size{0};
+void TaskQueue::enqueue(Task* const task)
+{
+    if (is_iterating_)
+        deferred_.push_back(task);
+    else
+        queue_.push_back(task);
+}
 
-    // Poll tasks in the current batch
-    for (auto& task : queue_)
+void TaskQueue::apply_deferred()
+{
+    assert(!is_iterating_);
+
+    // NOTE: Deferred tasks are added in the order they were pushed. Scheduled tasks are told apart
+    // by their status.
+    for (Task* const task : deferred_)
     {
-        if (task == nullptr)
-            break;
+        if (task != nullptr && task->status.load() == Task::Status_Scheduled)
+            schedule(task, task->due_time);
+        else
+            queue_.push_back(task);
+    }
+
+    deferred_.clear();
+
+    // NOTE: Cancelling can defer further cancels which are applied before it returns
+    if (is_cancel_all_deferred_)
+    {
+        is_cancel_all_deferred_ = false;
+        deferred_cancels_.clear();
+        cancel_all();
+    }
+    else if (!deferred_cancels_.empty())
+    {
+        DynamicArray<void*> contexts{allocator()};
+        contexts.swap(deferred_cancels_);
+
+        cancel_if([&](Task const* const task) {
+            return std::find(contexts.begin(), contexts.end(), task->context) != contexts.end();
+        });
+    }
+}
+
+void TaskQueue::take_due()
+{
+    // NOTE: Only the earliest timer is checked so this is cheap while nothing is due
+    while (!timers_.empty() && timers_.front().time <= time_)
+    {
+        std::pop_heap(timers_.begin(), timers_.end(), Timer::is_later);
+        Task* const task = timers_.back().task;
+        timers_.pop_back();
+
+        task->status.store(Task::Status_Queued);
+        queue_.push_back(task);
+
+#ifdef DR_APP_TASK_STATS
+        task->times.push = task_stats_now();
+        stats_.max_size = std::max(stats_.max_size, size());
+#endif
+    }
+}
+
+TaskHandle TaskQueue::post(void* const context, PollCallback* const poll_cb)
+{
+    assert(poll_cb != nullptr);
+
+    Shared& state = shared();
+    Task* entry{};
+    {
+        std::scoped_lock const lock{state.mutex};
+        entry = state.pool.make({}, context, poll_cb, WorkerPool::Priority_Normal, 0);
+    }
+
+    entry->completions = &state.completed;
+    entry->is_concurrent = true;
+    entry->status.store(Task::Status_Completed);
+
+    // NOTE: Handle is created before the task is visible to poll
+    TaskHandle const handle{entry, entry->generation};
+    state.completed.push(entry);
+    return handle;
+}
+
+TaskQueue::Shared& TaskQueue::shared()
+{
+    Shared* state = shared_.load(std::memory_order_acquire);
+
+    // NOTE: Other threads may be creating the state at the same time in which case the first one
+    // to publish it wins
+    if (state == nullptr)
+    {
+        auto created = std::make_unique<Shared>(allocator());
+
+        if (shared_.compare_exchange_strong(state, created.get(), std::memory_order_acq_rel))
+            state = created.release();
+    }
+
+    return *state;
+}
+
+void TaskQueue::take_shared()
+{
+    // Collect tasks that have completed since the last poll
+    for (Task* task = shared().completed.take_all(); task != nullptr; task = task->next)
+    {
+        // NOTE: Posted events count as in flight once they've been collected
+        if (!task->ref.is_valid())
+            ++num_submitted_;
+
+        completed_.push_back(task);
+    }
+
+    // NOTE: Tasks pushed from other threads are collected after completed tasks. Any follow-up
+    // tasks pushed by a completed task are guaranteed to be seen here.
+    take_intake();
+}
+
+void TaskQueue::take_intake()
+{
+    for (Task* task = shared().intake.take_all(); task != nullptr;)
+    {
+        // NOTE: Next is read first since the link is reused once the task completes
+        Task* const next = task->next;
+        enqueue(task);
+        task = next;
+    }
+
+#ifdef DR_APP_TASK_STATS
+    stats_.max_size = std::max(stats_.max_size, size());
+#endif
+}
+
+void TaskQueue::poll() { poll(std::numeric_limits<u64>::max(), max_poll_events); }
+
+void TaskQueue::poll(u64 const max_time, isize const max_events)
+{
+    assert(max_events > 0);
+
+    // NOTE: Poll callbacks can't poll the queue (see PollCallback)
+    assert(!is_iterating_);
+
+    take_shared();
+    take_due();
+
+    handle_completed(max_time, max_events);
+    submit_queued();
+}
+
+void TaskQueue::handle_completed(u64 const max_time, isize const max_events)
+{
+    if (completed_.empty())
+        return;
+
+    bool const is_timed = max_time != std::numeric_limits<u64>::max();
+    u64 const start_time = (is_timed) ? task_stats_now() : 0;
+    isize num_events{0};
+
+    // Tasks are handled in the order they completed. If the callback returns false or the budget
+    // has been spent, the task is kept until the next poll.
+    auto const handle = [&](Task* const task) -> bool {
+        if (num_events >= max_events
+            || (is_timed && num_events > 0 && task_stats_now() - start_time >= max_time))
+        {
+            // Skip the clock for remaining tasks once the budget is spent
+            num_events = max_events;
+            return false;
+        }
+
+        ++num_events;
 
-        Task::Status const status = task->status.load();
-        switch (status)
+        if (task->is_cancelled.load())
+        {
+            task->raise_event(PollEvent::Cancelled);
+        }
+        else if (task->raise_event(PollEvent::AfterComplete))
         {
-            case Task::Status_Queued:
+#ifdef DR_APP_TASK_STATS
+            // NOTE: Posted events aren't timed
+            if (task->ref.is_valid())
             {
-                if (task->raise_event(PollEvent::BeforeSubmit))
-                {
-                    task->status.store(Task::Status_Submitted);
-                    ThreadPool::submit(task);
-                }
+                auto const& times = task->times;
+                stats_.submitted.add(times.start - times.submit);
+                stats_.running.add(times.complete - times.start);
+                stats_.completed.add(task_stats_now() - times.complete);
+            }
+#endif
+        }
+        else
+        {
+            return false;
+        }
+
+        --num_submitted_;
+        in_flight_cost_ -= task->cost;
+
+        // Periodic tasks are scheduled again unless they were cancelled
+        if (task->period > 0 && !task->is_cancelled.load())
+        {
+            u64 const elapsed = (time_ > task->due_time) ? time_ - task->due_time : 0;
+            schedule(task, task->due_time + (elapsed / task->period + 1) * task->period);
+        }
+        else
+        {
+            release_task(task);
+        }
+
+        return true;
+    };
+
+    is_iterating_ = true;
+    completed_.erase(
+        std::remove_if(completed_.begin(), completed_.end(), handle),
+        completed_.end());
+    is_iterating_ = false;
+
+    apply_deferred();
+}
+
+void TaskQueue::submit_queued()
+{
+    WorkerPool::Priority submit_priority{};
+
+    // Submits collected tasks as a single batch
+    auto const flush = [&]() {
+        if (!to_submit_.empty())
+        {
+            thread_pool().submit(
+                Span<TaskRef const>{to_submit_.data(), static_cast<isize>(to_submit_.size())},
+                submit_priority);
+
+            to_submit_.clear();
+        }
+    };
+
+    // Returns true if there's room in flight for the given task
+    auto const has_capacity = [&](Task const* const task) -> bool {
+        if (num_submitted_ == 0)
+            return true;
+
+        return num_submitted_ < max_in_flight_
+            && task->cost <= max_in_flight_cost_ - in_flight_cost_;
+    };
+
+    bool is_full{false};
+
+    // Submits the given task if there's room. Returns true if the task was submitted.
+    auto const submit = [&](Task* const task) -> bool {
+        // NOTE: Tasks are submitted in order so stop at the first one that doesn't fit
+        if (is_full || !has_capacity(task))
+        {
+            is_full = true;
+            return false;
+        }
+
+        if (!task->raise_event(PollEvent::BeforeSubmit))
+            return false;
+
+        task->status.store(Task::Status_Submitted);
+
+#ifdef DR_APP_TASK_STATS
+        task->times.submit = task_stats_now();
+        stats_.queued.add(task->times.submit - task->times.push);
+#endif
 
+        // Consecutive tasks with the same priority are submitted together
+        if (task->priority != submit_priority)
+        {
+            flush();
+            submit_priority = task->priority;
+        }
+
+        to_submit_.push_back(task);
+        ++num_submitted_;
+        in_flight_cost_ += task->cost;
+        return true;
+    };
+
+    is_iterating_ = true;
+
+    // Submit tasks whose dependencies are done first since they were queued earlier
+    if (!ready_.empty())
+    {
+        auto const submit_ready = [&](Task* const task) -> bool {
+            if (!submit(task))
+                return false;
+
+            --num_waiting_;
+            return true;
+        };
+
+        ready_.erase(std::remove_if(ready_.begin(), ready_.end(), submit_ready), ready_.end());
+    }
+
+    while (!is_full && !queue_.empty())
+    {
+        isize batch_size{0};
+        isize num_removed{0};
+
+        // Submit queued tasks in the current batch. Tasks with dependencies that aren't done yet
+        // are set aside until they are.
+        for (auto& task : queue_)
+        {
+            if (task == nullptr)
                 break;
+
+            if (task->num_dependencies > 0)
+            {
+                task->status.store(Task::Status_Waiting);
+                ++num_waiting_;
+                ++num_removed;
+                task = nullptr;
             }
-            case Task::Status_Completed:
+            else if (submit(task))
+            {
+                ++num_removed;
+                task = nullptr;
+            }
+            else if (is_full)
             {
-                if (task->raise_event(PollEvent::AfterComplete))
-                {
-                    pool_.release(task);
-                    task = nullptr;
-                }
-
                 break;
             }
-            default:
+
+            ++batch_size;
+        }
+
+        // Partition the batch, placing removed tasks at the front
+        for (isize i = 0, j = 0; i < batch_size; ++i)
+        {
+            if (queue_[i] == nullptr)
             {
+                queue_[i] = queue_[j];
+                queue_[j] = nullptr;
+                ++j;
             }
         }
 
-        ++batch_size;
+        // Remove submitted tasks from front of batch
+        for (isize i = 0; i < num_removed; ++i)
+            queue_.pop_front();
+
+        // Move on to the next batch once everything before the barrier has been handled
+        bool const is_batch_done = num_submitted_ == 0 && num_waiting_ == 0;
+        if (is_full || queue_.empty() || queue_.front() != nullptr || !is_batch_done)
+            break;
+
+        queue_.pop_front();
     }
 
-    // Partition the batch, placing nulls at the front
-    for (isize i = 0, j = 0; i < batch_size; ++i)
+    is_iterating_ = false;
+    flush();
+    apply_deferred();
+}
+
+void TaskQueue::release_task(Task* const task)
+{
+    // Dependents that were set aside are ready once their last dependency is done
+    for (Dependent* dep = task->dependents; dep != nullptr;)
     {
-        if (queue_[i] == nullptr)
+        Task* const dependent = dep->task;
+
+        // NOTE: Dependents cancelled before this task was done are skipped since their slots may
+        // have been reused
+        if (dep->generation == dependent->generation && --dependent->num_dependencies == 0
+            && dependent->status.load() == Task::Status_Waiting)
         {
-            queue_[i] = queue_[j];
-            queue_[j] = nullptr;
-            ++j;
+            dependent->status.store(Task::Status_Queued);
+            ready_.push_back(dependent);
         }
+
+        Dependent* const next = dep->next;
+        pool_.release_dependent(dep);
+        dep = next;
     }
 
-    // Remove nulls from front of batch
-    while (!queue_.empty() && queue_.front() == nullptr)
-        queue_.pop_front();
+    // Tasks with results are kept until their future is reset
+    if (task->is_held)
+    {
+        task->dependents = {};
+        task->status.store(Task::Status_Held);
+        return;
+    }
+
+    free_task(task);
+}
+
+void TaskQueue::release_result(TaskHandle const& handle)
+{
+    Task* const task = static_cast<Task*>(handle.task_);
+    assert(task->generation == handle.generation_ && task->is_held);
+
+    // NOTE: If the task isn't done yet, it's freed once it's been handled by poll
+    task->is_held = false;
+
+    if (task->status.load() == Task::Status_Held)
+        free_task(task);
+}
+
+void TaskQueue::free_task(Task* const task)
+{
+    // NOTE: Owned task is destroyed outside of the lock in case it's expensive
+    task->owned.reset();
+
+    if (task->is_concurrent)
+    {
+        Shared& state = shared();
+        std::scoped_lock const lock{state.mutex};
+        state.pool.release(task);
+    }
+    else
+    {
+        pool_.release(task);
+    }
+}
+
+template <typename Predicate>
+void TaskQueue::cancel_if(Predicate&& pred)
+{
+    // Make sure tasks completed or pushed by other threads are included
+    take_shared();
+    is_iterating_ = true;
+
+    // Tasks that haven't been submitted yet are removed immediately
+    auto const cancel = [&](Task* const task) -> bool {
+        // Keep barriers and tasks that don't match
+        if (task == nullptr || !pred(task))
+            return false;
+
+        task->raise_event(PollEvent::Cancelled);
+        release_task(task);
+        return true;
+    };
+
+    queue_.erase(std::remove_if(queue_.begin(), queue_.end(), cancel), queue_.end());
+
+    // Scheduled tasks are also removed immediately
+    auto const timers_end = std::remove_if(timers_.begin(), timers_.end(), [&](Timer const& timer) {
+        return cancel(timer.task);
+    });
+
+    if (timers_end != timers_.end())
+    {
+        timers_.erase(timers_end, timers_.end());
+        std::make_heap(timers_.begin(), timers_.end(), Timer::is_later);
+    }
+
+    if (num_waiting_ > 0 || num_submitted_ > 0)
+    {
+        auto const cancel_pending = [&](Task& task) {
+            switch (task.status.load())
+            {
+                case Task::Status_Waiting:
+                {
+                    if (cancel(&task))
+                        --num_waiting_;
+
+                    break;
+                }
+                case Task::Status_Submitted:
+                case Task::Status_Completed:
+                {
+                    // Tasks that have been submitted are handled by poll once they complete
+                    if (pred(&task))
+                        task.is_cancelled.store(true);
+
+                    break;
+                }
+                default:
+                {
+                }
+            }
+        };
+
+        pool_.for_each(cancel_pending);
+
+        // NOTE: Tasks released while visiting the shared pool need to take the lock so they're
+        // collected first
+        DynamicArray<Task*> shared_pending{allocator()};
+        {
+            Shared& state = shared();
+            std::scoped_lock const lock{state.mutex};
+            state.pool.for_each([&](Task& task) {
+                if (task.status.load() != Task::Status_Queued)
+                    shared_pending.push_back(&task);
+            });
+        }
+
+        for (Task* const task : shared_pending)
+            cancel_pending(*task);
+    }
+
+    if (!ready_.empty())
+    {
+        // NOTE: Cancelling a task can make its dependents ready so matching tasks are taken out
+        // before they're cancelled
+        DynamicArray<Task*> ready_cancelled{allocator()};
+        auto const take = [&](Task* const task) -> bool {
+            if (!pred(task))
+                return false;
+
+            ready_cancelled.push_back(task);
+            return true;
+        };
+
+        ready_.erase(std::remove_if(ready_.begin(), ready_.end(), take), ready_.end());
+        num_waiting_ -= static_cast<isize>(ready_cancelled.size());
+
+        for (Task* const task : ready_cancelled)
+            cancel(task);
+    }
+
+    is_iterating_ = false;
+    apply_deferred();
+}
+
+void TaskQueue::set_max_in_flight(isize const max_count, isize const max_cost)
+{
+    assert(max_count > 0);
+    assert(max_cost >= 0);
+    max_in_flight_ = max_count;
+    max_in_flight_cost_ = max_cost;
+}
+
+void TaskQueue::cancel(void* const context)
+{
+    if (is_iterating_)
+    {
+        deferred_cancels_.push_back(context);
+        return;
+    }
+
+    cancel_if([=](Task const* const task) { return task->context == context; });
+}
+
+void TaskQueue::cancel_all()
+{
+    if (is_iterating_)
+    {
+        is_cancel_all_deferred_ = true;
+        return;
+    }
+
+    cancel_if([](Task const*) { return true; });
+}
+
+bool TaskQueue::is_done(TaskHandle const& handle) const
+{
+    assert(handle.is_valid());
+
+    // NOTE: Task slots are never freed while the queue is alive so this is safe even if the
+    // referenced task has been released
+    Task const* const task = static_cast<Task const*>(handle.task_);
+    return task->generation != handle.generation_ || task->status.load() == Task::Status_Held;
+}
+
+void TaskQueue::wait(TaskHandle const& handle)
+{
+    // NOTE: Poll callbacks can't wait on the queue (see PollCallback)
+    assert(!is_iterating_);
+
+    // NOTE: Periodic tasks aren't done until they're cancelled so only their current run is waited
+    // on. They're scheduled again once it's been handled.
+    auto const is_finished = [&]() -> bool {
+        if (is_done(handle))
+            return true;
+
+        Task const* const task = static_cast<Task const*>(handle.task_);
+        return task->period > 0 && task->status.load() == Task::Status_Scheduled;
+    };
+
+    thread_pool().help_while([&]() {
+        poll();
+        return !is_finished();
+    });
+}
+
+CancelToken TaskQueue::cancel_token() { return running_task_token; }
+
+void TaskQueue::wait()
+{
+    // NOTE: Poll callbacks can't wait on the queue (see PollCallback)
+    assert(!is_iterating_);
+
+    thread_pool().help_while([this]() {
+        poll();
+        return size() > 0;
+    });
+}
+
+TaskQueue::TaskPool::TaskPool(TaskPool&& other) noexcept :
+    chunks_(std::move(other.chunks_)),
+    num_used_{std::exchange(other.num_used_, chunk_size)},
+    num_live_{std::exchange(other.num_live_, 0)},
+    free_{std::exchange(other.free_, nullptr)},
+    dependents_(std::move(other.dependents_)),
+    free_dependents_{std::exchange(other.free_dependents_, nullptr)}
+{
+    // NOTE: Free lists point into the moved storage so the source is left empty
+    other.chunks_.clear();
+    other.dependents_.clear();
+}
+
+TaskQueue::TaskPool& TaskQueue::TaskPool::operator=(TaskPool&& other) noexcept
+{
+    assert(allocator() == other.allocator());
+    assert(num_live_ == 0);
+
+    // NOTE: Chunks can't be moved element-wise since tasks are referenced by address so storage is
+    // swapped instead. The other pool is left empty.
+    if (this != &other)
+    {
+        chunks_.swap(other.chunks_);
+        other.chunks_.clear();
+        dependents_.swap(other.dependents_);
+        other.dependents_.clear();
+
+        num_used_ = std::exchange(other.num_used_, chunk_size);
+        num_live_ = std::exchange(other.num_live_, 0);
+        free_ = std::exchange(other.free_, nullptr);
+        free_dependents_ = std::exchange(other.free_dependents_, nullptr);
+    }
+
+    return *this;
 }
 
 TaskQueue::Task* TaskQueue::TaskPool::make(
     TaskRef const& ref,
     void* const context,
-    PollCallback* const poll_cb)
+    PollCallback* const poll_cb,
+    WorkerPool::Priority const priority,
+    isize const cost)
 {
     Task* task{};
 
-    if (free_.empty())
+    if (free_ == nullptr)
     {
-        pool_.emplace_back();
-        task = &pool_.back();
+        if (num_used_ == chunk_size)
+        {
+            chunks_.emplace_back();
+            num_used_ = 0;
+        }
+
+        task = &chunks_.back().tasks[num_used_++];
     }
     else
     {
-        task = free_.back();
-        free_.pop_back();
+        task = free_;
+        free_ = task->next;
+        task->next = {};
     }
 
     task->ref = ref;
     task->context = context;
     task->poll_cb = poll_cb;
+    task->priority = priority;
+    task->cost = cost;
+    ++num_live_;
     return task;
 }
 
@@ -103,8 +1023,49 @@ void TaskQueue::TaskPool::release(Task* const task)
     task->ref = {};
     task->context = {};
     task->poll_cb = {};
+    task->priority = {};
+    task->cost = {};
+    task->due_time = {};
+    task->period = {};
+    task->num_dependencies = {};
+    task->dependents = {};
+    task->result = {};
+    task->is_concurrent = {};
+    task->is_held = {};
+    ++task->generation;
     task->status.store({});
-    free_.push_back(task);
+    task->is_cancelled.store(false);
+    task->next = free_;
+    free_ = task;
+    --num_live_;
+}
+
+TaskQueue::Dependent* TaskQueue::TaskPool::make_dependent(Task* const task, Dependent* const next)
+{
+    Dependent* dep{};
+
+    if (free_dependents_ == nullptr)
+    {
+        dependents_.emplace_back();
+        dep = &dependents_.back();
+    }
+    else
+    {
+        dep = free_dependents_;
+        free_dependents_ = dep->next;
+    }
+
+    dep->task = task;
+    dep->generation = task->generation;
+    dep->next = next;
+    return dep;
+}
+
+void TaskQueue::TaskPool::release_dependent(Dependent* const dependent)
+{
+    dependent->task = {};
+    dependent->next = free_dependents_;
+    free_dependents_ = dependent;
 }
 
 } // namespace dr
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include <dr/app/task_stats.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace dr
+{
+
+void DurationHistogram::add(u64 const duration)
+{
+    // Bucket i holds durations in [2^(i - 1), 2^i)
+    isize bucket = 0;
+    for (u64 d = duration; d > 0 && bucket < num_buckets - 1; d >>= 1)
+        ++bucket;
+
+    ++counts[bucket];
+    ++count;
+    total += duration;
+    max = std::max(max, duration);
+}
+
+void DurationHistogram::merge(DurationHistogram const& other)
+{
+    for (isize i = 0; i < num_buckets; ++i)
+        counts[i] += other.counts[i];
+
+    count += other.count;
+    total += other.total;
+    max = std::max(max, other.max);
+}
+
+u64 DurationHistogram::percentile(f64 const p) const
+{
+    assert(p >= 0.0 && p <= 1.0);
+
+    if (count == 0)
+        return 0;
+
+    u64 const rank = std::max<u64>(static_cast<u64>(p * count + 0.5), 1);
+    u64 sum = 0;
+
+    for (isize i = 0; i < num_buckets; ++i)
+    {
+        sum += counts[i];
+        if (sum >= rank)
+            return std::min((u64{1} << i) - 1, max);
+    }
+
+    return max;
+}
+
+u64 task_stats_now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace dr
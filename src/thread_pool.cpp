@@ -1,99 +1,1252 @@
 #include <dr/app/thread_pool.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <thread>
 
 #include <dr/deque.hpp>
 #include <dr/dynamic_array.hpp>
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 namespace dr
 {
 namespace
 {
 
-struct
+constexpr isize cache_line_size = 64;
+constexpr isize scratch_buffer_size = isize{64} << 10;
+constexpr isize default_spin_count = 256;
+constexpr isize owned_chunk_size = 256;
+constexpr isize max_owned_chunks = 4096;
+constexpr isize max_local_owned_tasks = 64;
+
+/// Hints to the CPU that the calling thread is busy-waiting
+inline void cpu_relax()
 {
-    DynamicArray<std::thread> workers;
-    Deque<TaskRef> tasks;
-    std::mutex mutex;
-    std::condition_variable condition;
-    bool is_active{false};
-} state;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+/// Lets threads park on a condition without holding a lock while they check it. A waiter first
+/// announces itself with prepare_wait, re-checks the condition, then either cancels or commits
+/// to the wait. Notifiers skip the lock entirely when nobody is waiting.
+struct EventCount
+{
+    /// Registers the calling thread as a waiter. Returns a key to pass to commit_wait.
+    u64 prepare_wait()
+    {
+        // NOTE: Sequentially consistent to pair with the load in notify. Either the waiter sees
+        // the notifier's change to the condition or the notifier sees the waiter.
+        num_waiters_.fetch_add(1);
+        return epoch_.load();
+    }
 
-constexpr TaskRef invalid_task{};
+    /// Unregisters the calling thread after the condition was found to be satisfied
+    void cancel_wait() { num_waiters_.fetch_sub(1); }
 
-void do_work()
+    /// Blocks until notified after the given call to prepare_wait
+    void commit_wait(u64 const key)
+    {
+        {
+            std::unique_lock lock{mutex_};
+            condition_.wait(lock, [&]() { return epoch_.load(std::memory_order_relaxed) != key; });
+        }
+
+        num_waiters_.fetch_sub(1);
+    }
+
+    /// Wakes up to the given number of waiters
+    void notify(isize const count)
+    {
+        isize const n = num_waiters_.load();
+        if (n == 0)
+            return;
+
+        {
+            std::scoped_lock const lock{mutex_};
+            epoch_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (count >= n)
+            condition_.notify_all();
+        else
+            for (isize i = 0; i < count; ++i)
+                condition_.notify_one();
+    }
+
+    /// Wakes all waiters
+    void notify_all() { notify(num_waiters_.load()); }
+
+    /// Returns the number of waiters at the time of the call
+    isize num_waiters() const { return num_waiters_.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<isize> num_waiters_{0};
+    std::atomic<u64> epoch_{0};
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
+/// Fixed-capacity Chase-Lev work-stealing deque. The owning worker pushes and pops tasks at the
+/// bottom while other threads steal from the top.
+struct WorkDeque
 {
-    while (true)
+    static constexpr isize capacity = 1024;
+    static_assert((capacity & (capacity - 1)) == 0);
+
+    /// Pushes a task onto the bottom of the deque. Returns false if the deque is full. Only called
+    /// by the owning worker.
+    bool push(TaskRef const& task)
     {
-        TaskRef task{};
+        isize const b = bottom_.load(std::memory_order_relaxed);
+        isize const t = top_.load(std::memory_order_acquire);
+
+        if (b - t >= capacity)
+            return false;
+
+        slots_[b & (capacity - 1)].store(task);
+
+        // NOTE: Sequentially consistent to pair with sleeping workers (see wait_for_work)
+        bottom_.store(b + 1);
+        return true;
+    }
+
+    /// Pops a task off the bottom of the deque. Only called by the owning worker.
+    bool pop(TaskRef& task)
+    {
+        isize const b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b);
+        isize t = top_.load();
 
-        // Pop a task off the queue when one becomes available
+        if (t > b)
         {
-            std::unique_lock lock{state.mutex};
-            state.condition.wait(lock, []() { return !state.tasks.empty(); });
+            // Deque was empty
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        task = slots_[b & (capacity - 1)].load();
 
-            task = state.tasks.front();
-            state.tasks.pop_front();
+        if (t == b)
+        {
+            // Last task in the deque so race against stealers
+            bool const ok = top_.compare_exchange_strong(t, t + 1);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return ok;
         }
 
-        // If task is invalid, then stop has been requested
-        if (!task.is_valid())
-            return;
+        return true;
+    }
+
+    /// Steals a task from the top of the deque. Can be called from any thread.
+    bool steal(TaskRef& task)
+    {
+        isize t = top_.load();
+        isize const b = bottom_.load();
+
+        if (t >= b)
+            return false;
 
-        task();
+        task = slots_[t & (capacity - 1)].load();
+        return top_.compare_exchange_strong(t, t + 1);
     }
+
+    /// Returns true if the deque appears to be empty at the time of the call
+    bool is_empty() const { return top_.load() >= bottom_.load(); }
+
+    /// Returns the number of tasks in the deque at the time of the call
+    isize size() const { return std::max<isize>(bottom_.load() - top_.load(), 0); }
+
+  private:
+    /// Stores a task as a pair of atomic words. This allows stealers to read slots that are
+    /// concurrently being written. Torn reads are discarded by the compare-exchange on top.
+    struct Slot
+    {
+        static constexpr isize num_words = sizeof(TaskRef) / sizeof(uintptr_t);
+        static_assert(sizeof(TaskRef) == num_words * sizeof(uintptr_t));
+        static_assert(std::is_trivially_copyable_v<TaskRef>);
+
+        std::atomic<uintptr_t> words[num_words];
+
+        void store(TaskRef const& task)
+        {
+            uintptr_t src[num_words];
+            std::memcpy(src, &task, sizeof(TaskRef));
+
+            for (isize i = 0; i < num_words; ++i)
+                words[i].store(src[i], std::memory_order_relaxed);
+        }
+
+        TaskRef load() const
+        {
+            uintptr_t dst[num_words];
+            for (isize i = 0; i < num_words; ++i)
+                dst[i] = words[i].load(std::memory_order_relaxed);
+
+            TaskRef task;
+            std::memcpy(&task, dst, sizeof(TaskRef));
+            return task;
+        }
+    };
+
+    alignas(cache_line_size) std::atomic<isize> top_{0};
+    alignas(cache_line_size) std::atomic<isize> bottom_{0};
+    alignas(cache_line_size) Slot slots_[capacity]{};
+};
+
+#if defined(__linux__)
+
+/// Reads an integer from the given file. Returns the default value if the file can't be read.
+i32 read_int(char const* const path, i32 const default_value)
+{
+    i32 result = default_value;
+
+    if (std::FILE* const f = std::fopen(path, "r"))
+    {
+        if (std::fscanf(f, "%d", &result) != 1)
+            result = default_value;
+
+        std::fclose(f);
+    }
+
+    return result;
+}
+
+/// Returns true if the given CPU appears in a CPU list file (e.g. "0-3,8,10-11")
+bool is_cpu_listed(char const* const path, i32 const cpu)
+{
+    std::FILE* const f = std::fopen(path, "r");
+    if (f == nullptr)
+        return false;
+
+    bool result = false;
+    i32 first, last;
+
+    while (!result && std::fscanf(f, "%d", &first) == 1)
+    {
+        last = first;
+
+        int c = std::fgetc(f);
+        if (c == '-')
+        {
+            if (std::fscanf(f, "%d", &last) != 1)
+                break;
+
+            c = std::fgetc(f);
+        }
+
+        result = (cpu >= first && cpu <= last);
+
+        if (c != ',')
+            break;
+    }
+
+    std::fclose(f);
+    return result;
+}
+
+/// Returns one logical CPU per physical core available to the process. Performance cores are
+/// listed before efficiency cores on hybrid CPUs.
+DynamicArray<i32> get_physical_cpus(Allocator const alloc)
+{
+    struct CpuInfo
+    {
+        i32 cpu;
+        i32 package;
+        i32 core;
+        i32 capacity;
+    };
+
+    DynamicArray<i32> result{alloc};
+
+    cpu_set_t available;
+    CPU_ZERO(&available);
+
+    if (sched_getaffinity(0, sizeof(available), &available) != 0)
+        return result;
+
+    DynamicArray<CpuInfo> infos{alloc};
+    char path[128];
+
+    for (i32 cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!CPU_ISSET(cpu, &available))
+            continue;
+
+        CpuInfo info{cpu, 0, cpu, 1024};
+
+        std::snprintf(
+            path,
+            sizeof(path),
+            "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+            cpu);
+        info.package = read_int(path, info.package);
+
+        std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        info.core = read_int(path, info.core);
+
+        // NOTE: Relative capacity is reported on ARM big.LITTLE systems while Intel hybrid systems
+        // list efficiency cores separately
+        std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+        info.capacity = read_int(path, info.capacity);
+
+        if (is_cpu_listed("/sys/devices/cpu_atom/cpus", cpu))
+            info.capacity /= 2;
+
+        // Skip SMT siblings of cores that have already been seen
+        bool const is_sibling = std::any_of(infos.begin(), infos.end(), [&](CpuInfo const& other) {
+            return other.package == info.package && other.core == info.core;
+        });
+
+        if (!is_sibling)
+            infos.push_back(info);
+    }
+
+    std::stable_sort(infos.begin(), infos.end(), [](CpuInfo const& a, CpuInfo const& b) {
+        return a.capacity > b.capacity;
+    });
+
+    for (auto const& info : infos)
+        result.push_back(info.cpu);
+
+    return result;
 }
 
+#else
+
+DynamicArray<i32> get_physical_cpus(Allocator const alloc) { return DynamicArray<i32>{alloc}; }
+
+#endif
+
 } // namespace
 
-void ThreadPool::start(isize const num_workers)
+struct WorkerPool::State
 {
-    assert(num_workers > 0);
+    struct alignas(cache_line_size) Worker
+    {
+        WorkDeque tasks;
+        std::thread thread;
+        State* pool;
+        isize index;
 
-    // Wrap up any in progress tasks
-    if (state.is_active)
-        ThreadPool::stop();
+        // Scratch memory for tasks. This is reset after each top-level task completes.
+        DynamicArray<std::byte> scratch_buffer;
+        std::pmr::monotonic_buffer_resource scratch;
+        isize task_depth{0};
 
-    state.workers.resize(num_workers);
+        // Owned task slots released on this worker. Only accessed by the worker itself.
+        u32 free_owned_tasks{0}; // Index + 1 of the first free slot, zero if none
+        u32 last_free_owned_task{0};
+        isize num_free_owned_tasks{0};
 
-    for (auto& worker : state.workers)
-        worker = std::thread{do_work};
+#ifdef DR_APP_TASK_STATS
+        std::atomic<u64> num_tasks{0};
+        std::atomic<u64> num_steals{0};
+        std::atomic<u64> busy_time{0};
+#endif
+
+        Worker(State* const pool, isize const index, Allocator const alloc) :
+            pool{pool},
+            index{index},
+            scratch_buffer(scratch_buffer_size, alloc),
+            scratch{scratch_buffer.data(), scratch_buffer.size(), alloc.resource()}
+        {
+        }
+
+        /// Invokes the given task on this worker
+        void run(TaskRef const& task)
+        {
+#ifdef DR_APP_TASK_STATS
+            u64 const start_time = task_stats_now();
+            num_tasks.fetch_add(1, std::memory_order_relaxed);
+#endif
+            ++task_depth;
+            task();
+
+            // NOTE: Tasks can run other tasks (e.g. while helping) so scratch memory is only reset
+            // once the outermost task is done
+            if (--task_depth == 0)
+            {
+                scratch.release();
+#ifdef DR_APP_TASK_STATS
+                busy_time.fetch_add(task_stats_now() - start_time, std::memory_order_relaxed);
+#endif
+            }
+        }
+    };
+
+    inline static thread_local Worker* this_worker{};
+    inline static thread_local State* this_inline_pool{};
+
+    // NOTE: Workers are only created by the thread that owns the pool. Other threads access them
+    // through slots which are stable while the pool is active.
+    Deque<Worker> workers;
+    std::atomic<Worker*> slots[max_workers]{};
+    std::atomic<isize> num_slots{0};
+
+    // Workers at or above this index are retired. They park until the pool grows again. With no
+    // active workers, tasks are run inline by submitting threads.
+    std::atomic<isize> num_active{0};
+    std::atomic<bool> is_active{false};
+    std::mutex retire_mutex;
+    std::condition_variable retire_condition;
+
+    // Injection queues for tasks submitted from outside the pool (one per priority)
+    Deque<TaskRef> tasks[_Priority_Count];
+    std::atomic<isize> num_tasks[_Priority_Count]{};
+    std::mutex mutex;
+
+    /// Slot for a task owned by the pool. Slots are recycled once their task has run.
+    struct OwnedTask
+    {
+        UniqueTask task;
+        State* pool;
+        u32 index;
+        std::atomic<u32> next_free{0}; // Index + 1 of the next free slot, zero if none
+
+        void operator()()
+        {
+            task();
+            task.reset();
+            pool->release_owned_task(this);
+        }
+    };
+
+    struct OwnedChunk
+    {
+        OwnedTask tasks[owned_chunk_size];
+    };
+
+    // Slots for owned tasks. Slots are referred to by index so free lists can be linked without
+    // pointers. Chunks are only added under the lock while the pool warms up.
+    Deque<OwnedChunk> owned_chunks;
+    std::atomic<OwnedChunk*> owned_chunk_ptrs[max_owned_chunks]{};
+    isize num_owned_tasks{0};
+    std::mutex owned_mutex;
+
+    // Free slots shared by all threads. Workers keep their own free lists and only fall back to
+    // this one when theirs runs dry or grows too long. The head packs the index of the first slot
+    // with a counter that changes on every update to avoid the ABA problem.
+    std::atomic<u64> free_owned_tasks{0};
+
+    // Bounds the number of threads running low priority tasks at once. The limit given by the
+    // user is kept separately so it survives resizing (zero if none was given).
+    std::atomic<isize> num_low_priority_running{0};
+    std::atomic<isize> max_low_priority_running{1};
+    std::atomic<isize> low_priority_limit{0};
+
+    // Idle workers spin for a while before parking
+    EventCount idle;
+    std::atomic<isize> spin_count{default_spin_count};
+    std::atomic<bool> is_stopping{false};
+
+    // Applied to each worker thread as it starts
+    Affinity affinity{Affinity_None};
+    DynamicArray<i32> cpus;
+    char name[16]{"dr-worker"};
+
+#ifdef DR_APP_TASK_STATS
+    std::atomic<u64> stats_start_time{0};
+#endif
+
+    State(Allocator const alloc) :
+        workers(alloc),
+        tasks{Deque<TaskRef>(alloc), Deque<TaskRef>(alloc), Deque<TaskRef>(alloc)},
+        owned_chunks(alloc),
+        cpus(alloc)
+    {
+        static_assert(_Priority_Count == 3);
+    }
+
+    /// Returns the calling thread's worker if it belongs to this pool
+    Worker* local_worker() const
+    {
+        return (this_worker != nullptr && this_worker->pool == this) ? this_worker : nullptr;
+    }
+
+    /// Returns the owned task slot at the given index
+    OwnedTask& owned_task(u32 const index) const
+    {
+        OwnedChunk* const chunk =
+            owned_chunk_ptrs[index / owned_chunk_size].load(std::memory_order_acquire);
+
+        return chunk->tasks[index % owned_chunk_size];
+    }
+
+    /// Adds a new owned task slot
+    OwnedTask* add_owned_task()
+    {
+        std::scoped_lock const lock{owned_mutex};
+
+        isize const index = num_owned_tasks++;
+        assert(index < owned_chunk_size * max_owned_chunks);
+
+        if (index % owned_chunk_size == 0)
+        {
+            owned_chunks.emplace_back();
+            owned_chunk_ptrs[index / owned_chunk_size].store(
+                &owned_chunks.back(),
+                std::memory_order_release);
+        }
+
+        OwnedTask* const slot = &owned_chunks.back().tasks[index % owned_chunk_size];
+        slot->pool = this;
+        slot->index = static_cast<u32>(index);
+        return slot;
+    }
+
+    /// Pushes a list of free slots linked from first to last onto the shared free list
+    void push_free_owned_tasks(OwnedTask& first, OwnedTask& last)
+    {
+        u64 head = free_owned_tasks.load(std::memory_order_relaxed);
+        u64 new_head;
+
+        do
+        {
+            last.next_free.store(static_cast<u32>(head), std::memory_order_relaxed);
+            new_head = ((head >> 32) + 1) << 32 | (first.index + 1);
+        } while (!free_owned_tasks.compare_exchange_weak(
+            head,
+            new_head,
+            std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+
+    /// Pops a free slot off the shared free list. Returns null if the list is empty.
+    OwnedTask* pop_free_owned_task()
+    {
+        u64 head = free_owned_tasks.load(std::memory_order_acquire);
+
+        while (u32 const first = static_cast<u32>(head))
+        {
+            // NOTE: The slot can be taken and relinked by another thread in the meantime. Its
+            // next link may be stale then, but the counter in the head makes the exchange fail.
+            OwnedTask& slot = owned_task(first - 1);
+            u32 const next = slot.next_free.load(std::memory_order_relaxed);
+            u64 const new_head = ((head >> 32) + 1) << 32 | next;
+
+            if (free_owned_tasks.compare_exchange_weak(
+                    head,
+                    new_head,
+                    std::memory_order_acquire,
+                    std::memory_order_acquire))
+                return &slot;
+        }
+
+        return nullptr;
+    }
+
+    /// Moves all of the given worker's free slots to the shared free list
+    void flush_free_owned_tasks(Worker& self)
+    {
+        if (self.free_owned_tasks == 0)
+            return;
+
+        push_free_owned_tasks(
+            owned_task(self.free_owned_tasks - 1),
+            owned_task(self.last_free_owned_task - 1));
+
+        self.free_owned_tasks = 0;
+        self.last_free_owned_task = 0;
+        self.num_free_owned_tasks = 0;
+    }
+
+    OwnedTask* make_owned_task(UniqueTask&& task)
+    {
+        OwnedTask* slot{};
+
+        // Workers take slots from their own free list first
+        if (Worker* const self = local_worker(); self && self->free_owned_tasks != 0)
+        {
+            slot = &owned_task(self->free_owned_tasks - 1);
+            self->free_owned_tasks = slot->next_free.load(std::memory_order_relaxed);
+            --self->num_free_owned_tasks;
+
+            if (self->free_owned_tasks == 0)
+                self->last_free_owned_task = 0;
+        }
+        else
+        {
+            slot = pop_free_owned_task();
+
+            if (slot == nullptr)
+                slot = add_owned_task();
+        }
+
+        slot->task = std::move(task);
+        return slot;
+    }
+
+    void release_owned_task(OwnedTask* const slot)
+    {
+        Worker* const self = local_worker();
+
+        if (self == nullptr)
+        {
+            push_free_owned_tasks(*slot, *slot);
+            return;
+        }
+
+        // Slots released on a worker go to its own free list. Once the list grows too long
+        // (e.g. when tasks are submitted from outside the pool), it's handed over to the shared
+        // list in one go.
+        slot->next_free.store(self->free_owned_tasks, std::memory_order_relaxed);
+        self->free_owned_tasks = slot->index + 1;
+
+        if (self->last_free_owned_task == 0)
+            self->last_free_owned_task = slot->index + 1;
+
+        if (++self->num_free_owned_tasks >= max_local_owned_tasks)
+            flush_free_owned_tasks(*self);
+    }
+
+    bool pop_injected(Priority const priority, TaskRef& task)
+    {
+        if (num_tasks[priority].load() == 0)
+            return false;
+
+        std::scoped_lock const lock{mutex};
+        auto& queue = tasks[priority];
+
+        if (queue.empty())
+            return false;
+
+        task = queue.front();
+        queue.pop_front();
+        num_tasks[priority].fetch_sub(1);
+        return true;
+    }
+
+    bool steal(Worker* const self, TaskRef& task)
+    {
+        isize const n = num_slots.load(std::memory_order_acquire);
+        isize const offset = (self) ? self->index + 1 : 0;
+
+        // Visit peers in round-robin order starting after the calling worker. Retired workers are
+        // included since they may still have tasks left in their deques.
+        for (isize i = 0; i < n; ++i)
+        {
+            Worker& victim = *slots[(offset + i) % n].load(std::memory_order_relaxed);
+            if (&victim != self && victim.tasks.steal(task))
+            {
+#ifdef DR_APP_TASK_STATS
+                if (self)
+                    self->num_steals.fetch_add(1, std::memory_order_relaxed);
+#endif
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool find_task(Worker* const self, TaskRef& task)
+    {
+        // Prefer high priority submissions, then the most recently pushed local task, then normal
+        // priority submissions, then peers
+        return pop_injected(Priority_High, task) || (self && self->tasks.pop(task))
+            || pop_injected(Priority_Normal, task) || steal(self, task);
+    }
+
+    /// Updates the max number of threads running low priority tasks for the given number of
+    /// workers. Without a limit from the user, at least one worker is left free for higher
+    /// priority tasks.
+    void update_max_low_priority_running(isize const num_workers)
+    {
+        isize const limit = low_priority_limit.load();
+
+        if (limit > 0)
+            max_low_priority_running.store(std::min(limit, std::max<isize>(num_workers, 1)));
+        else
+            max_low_priority_running.store(std::max<isize>(num_workers - 1, 1));
+    }
+
+    bool can_run_low_priority() const
+    {
+        return num_low_priority_running.load() < max_low_priority_running.load();
+    }
 
-    state.is_active = true;
+    bool acquire_low_priority()
+    {
+        isize n = num_low_priority_running.load();
+
+        while (n < max_low_priority_running.load())
+        {
+            if (num_low_priority_running.compare_exchange_weak(n, n + 1))
+                return true;
+        }
+
+        return false;
+    }
+
+    void release_low_priority()
+    {
+        num_low_priority_running.fetch_sub(1);
+
+        // Hand the slot off to a parked worker if there are low priority tasks waiting on it
+        if (num_tasks[Priority_Low].load() > 0)
+            wake_workers(1);
+    }
+
+    static void run(Worker* const self, TaskRef const& task)
+    {
+        if (self)
+            self->run(task);
+        else
+            task();
+    }
+
+    bool try_run_task(Worker* const self)
+    {
+        TaskRef task{};
+
+        if (find_task(self, task))
+        {
+            run(self, task);
+            return true;
+        }
+
+        // Low priority tasks are only run if there's room under the limit
+        if (num_tasks[Priority_Low].load() > 0 && acquire_low_priority())
+        {
+            bool const found = pop_injected(Priority_Low, task);
+
+            if (found)
+                run(self, task);
+
+            release_low_priority();
+            return found;
+        }
+
+        return false;
+    }
+
+    bool has_work() const
+    {
+        if (num_tasks[Priority_High].load() > 0 || num_tasks[Priority_Normal].load() > 0)
+            return true;
+
+        // NOTE: Queued low priority tasks don't count if they can't be run yet. They'll be picked
+        // up by whichever thread is holding the slot once it's done.
+        if (num_tasks[Priority_Low].load() > 0 && can_run_low_priority())
+            return true;
+
+        isize const n = num_slots.load(std::memory_order_acquire);
+
+        for (isize i = 0; i < n; ++i)
+        {
+            if (!slots[i].load(std::memory_order_relaxed)->tasks.is_empty())
+                return true;
+        }
+
+        return false;
+    }
+
+    bool is_retired(Worker const& self) const { return self.index >= num_active.load(); }
+
+    void wake_workers(isize const count) { idle.notify(count); }
+
+    /// Waits for new work to be submitted or for the calling worker to be retired. Workers spin
+    /// briefly before parking since a parked worker takes much longer to wake. Returns false if
+    /// the worker should exit.
+    bool wait_for_work(Worker const& self)
+    {
+        isize const num_spins = spin_count.load(std::memory_order_relaxed);
+
+        for (isize i = 0; i < num_spins; ++i)
+        {
+            if (has_work() || is_retired(self))
+                return true;
+
+            // Back off to yielding in the second half so spinning workers don't hog cores that
+            // other threads could use
+            if (i < num_spins / 2)
+                cpu_relax();
+            else
+                std::this_thread::yield();
+        }
+
+        u64 const key = idle.prepare_wait();
+
+        if (has_work() || is_retired(self))
+        {
+            idle.cancel_wait();
+            return true;
+        }
+
+        if (is_stopping.load())
+        {
+            idle.cancel_wait();
+            return false;
+        }
+
+        idle.commit_wait(key);
+        return true;
+    }
+
+    /// Runs pending tasks on the calling thread until there are none left. Tasks submitted by
+    /// inline tasks are queued and run once the current task returns rather than recursively. This
+    /// keeps tasks in submission order and the stack depth bounded.
+    void run_inline()
+    {
+        if (this_inline_pool == this)
+            return;
+
+        State* const prev_pool = this_inline_pool;
+        this_inline_pool = this;
+
+        Worker* const self = local_worker();
+        while (try_run_task(self))
+            ;
+
+        this_inline_pool = prev_pool;
+    }
+
+    /// Parks the calling worker while it's retired. Returns false if the worker should exit.
+    bool wait_for_reactivation(Worker const& self)
+    {
+        std::unique_lock lock{retire_mutex};
+        retire_condition.wait(lock, [&]() { return !is_retired(self) || is_stopping.load(); });
+        return !is_retired(self);
+    }
+
+    /// Names the calling worker's thread and applies the pool's affinity policy to it
+    void init_thread([[maybe_unused]] Worker const& self) const
+    {
+#if defined(__linux__) || defined(__APPLE__)
+        // NOTE: Thread names are limited to 15 characters on Linux so the pool name is cut short
+        // to make room for the index
+        char suffix[24];
+        int const suffix_len = std::snprintf(suffix, sizeof(suffix), "-%td", self.index);
+
+        char thread_name[48];
+        std::snprintf(thread_name, sizeof(thread_name), "%.*s%s", 15 - suffix_len, name, suffix);
+        thread_name[15] = '\0';
+#endif
+
+#if defined(__linux__)
+        pthread_setname_np(pthread_self(), thread_name);
+
+        isize const num_cpus = static_cast<isize>(cpus.size());
+
+        if (affinity != Affinity_None && num_cpus > 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+
+            if (affinity == Affinity_PhysicalCores)
+            {
+                CPU_SET(cpus[self.index % num_cpus], &set);
+            }
+            else
+            {
+                for (i32 const cpu : cpus)
+                    CPU_SET(cpu, &set);
+            }
+
+            // NOTE: Failure isn't fatal since the worker can still run wherever it's scheduled
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+#elif defined(__APPLE__)
+        pthread_setname_np(thread_name);
+#endif
+    }
+
+    static void do_work(Worker& self)
+    {
+        this_worker = &self;
+        State& state = *self.pool;
+        state.init_thread(self);
+
+        while (true)
+        {
+            if (state.is_retired(self))
+            {
+                // Finish up any tasks left in the local deque before parking. Nothing else will be
+                // pushed onto it until the worker is reactivated.
+                TaskRef task{};
+                while (self.tasks.pop(task))
+                    self.run(task);
+
+                if (!state.wait_for_reactivation(self))
+                    break;
+            }
+            else if (!state.try_run_task(&self) && !state.wait_for_work(self))
+            {
+                break;
+            }
+        }
+
+        // Hand any free slots back before the worker is destroyed
+        state.flush_free_owned_tasks(self);
+        this_worker = nullptr;
+    }
+};
+
+WorkerPool::WorkerPool(Allocator const alloc) : state_{std::make_unique<State>(alloc)} {}
+
+WorkerPool::~WorkerPool() { stop(); }
+
+Allocator WorkerPool::allocator() const { return state_->workers.get_allocator(); }
+
+void WorkerPool::start(isize const num_workers) { resize(num_workers); }
+
+void WorkerPool::start() { start(default_num_workers()); }
+
+void WorkerPool::resize(isize const num_workers)
+{
+    assert(num_workers >= 0 && num_workers <= max_workers);
+    State& state = *state_;
+
+    // Create any additional workers
+    isize const num_slots = state.num_slots.load();
+
+    for (isize i = num_slots; i < num_workers; ++i)
+    {
+        state.workers.emplace_back(&state, i, allocator());
+        state.slots[i].store(&state.workers.back(), std::memory_order_relaxed);
+    }
+
+    if (num_workers > num_slots)
+        state.num_slots.store(num_workers, std::memory_order_release);
+
+    state.update_max_low_priority_running(num_workers);
+
+    {
+        std::scoped_lock const lock{state.retire_mutex};
+        state.num_active.store(num_workers);
+    }
+
+    // Reactivate retired workers and let parked workers know if they've been retired
+    state.retire_condition.notify_all();
+    state.idle.notify_all();
+
+    // Anything left in the injection queues won't be picked up by workers in inline mode
+    if (num_workers == 0)
+        state.run_inline();
+
+    // NOTE: Threads are launched after slots are published since they may steal from each other
+    for (isize i = num_slots; i < num_workers; ++i)
+    {
+        State::Worker& worker = *state.slots[i].load(std::memory_order_relaxed);
+        worker.thread = std::thread{State::do_work, std::ref(worker)};
+    }
+
+#ifdef DR_APP_TASK_STATS
+    if (!state.is_active.load())
+        reset_stats();
+#endif
+
+    state.is_active.store(true);
 }
 
-void ThreadPool::stop()
+void WorkerPool::stop()
 {
-    if (!state.is_active)
+    State& state = *state_;
+
+    if (!state.is_active.load())
         return;
 
-    // Queue an invalid task for each thread
+    if (state.num_active.load() == 0)
+        state.run_inline();
+
+    // Active workers exit once there's no work left while retired workers exit right away
     {
-        std::scoped_lock const lock{state.mutex};
-        state.tasks.insert(state.tasks.end(), state.workers.size(), invalid_task);
+        std::scoped_lock const lock{state.retire_mutex};
+        state.is_stopping.store(true);
     }
-    state.condition.notify_all();
+    state.retire_condition.notify_all();
+    state.idle.notify_all();
 
     // Wait on workers to finish up remaining tasks
     for (auto& worker : state.workers)
-        worker.join();
+        worker.thread.join();
+
+    for (auto& slot : state.slots)
+        slot.store(nullptr, std::memory_order_relaxed);
+
+    state.workers.clear();
+    state.num_slots.store(0);
+    state.num_active.store(0);
+    state.is_stopping.store(false);
+    state.is_active.store(false);
+}
+
+void WorkerPool::submit(TaskRef const& task, Priority const priority)
+{
+    submit(Span<TaskRef const>{&task, 1}, priority);
+}
+
+void WorkerPool::submit(Span<TaskRef const> const& tasks, Priority const priority)
+{
+    assert(state_->is_active.load());
+    assert(priority < _Priority_Count);
+
+    isize const num_tasks = tasks.size();
+    isize i = 0;
+
+    // Normal priority tasks submitted from a worker go to its local deque until full
+    if (State::Worker* const self = state_->local_worker(); self && priority == Priority_Normal)
+    {
+        for (; i < num_tasks; ++i)
+        {
+            assert(tasks[i].is_valid());
+            if (!self->tasks.push(tasks[i]))
+                break;
+        }
+    }
+
+    // Any remaining tasks go to the injection queue under a single lock
+    if (i < num_tasks)
+    {
+        std::scoped_lock const lock{state_->mutex};
+        auto& queue = state_->tasks[priority];
+
+        for (isize j = i; j < num_tasks; ++j)
+        {
+            assert(tasks[j].is_valid());
+            queue.push_back(tasks[j]);
+        }
 
-    state.is_active = false;
+        state_->num_tasks[priority].fetch_add(num_tasks - i);
+    }
+
+    state_->wake_workers(num_tasks);
+
+    // With no active workers, tasks are run on the submitting thread
+    if (state_->num_active.load() == 0)
+        state_->run_inline();
 }
 
-void ThreadPool::submit(TaskRef const& task)
+void WorkerPool::submit(UniqueTask&& task, Priority const priority)
 {
-    assert(state.is_active);
     assert(task.is_valid());
+    submit(state_->make_owned_task(std::move(task)), priority);
+}
+
+void WorkerPool::set_max_low_priority_workers(isize const count)
+{
+    assert(count > 0);
+    state_->low_priority_limit.store(count);
+    state_->update_max_low_priority_running(num_workers());
+
+    // Wake any workers that were parked while low priority tasks were over the limit
+    state_->wake_workers(count);
+}
+
+isize WorkerPool::max_low_priority_workers() const
+{
+    return state_->max_low_priority_running.load(std::memory_order_relaxed);
+}
+
+void WorkerPool::set_spin_count(isize const count)
+{
+    assert(count >= 0);
+    state_->spin_count.store(count, std::memory_order_relaxed);
+}
+
+void WorkerPool::set_affinity(Affinity const affinity, Span<i32 const> const& cpus)
+{
+    assert(affinity < _Affinity_Count);
+    State& state = *state_;
+    state.affinity = affinity;
+
+    if (affinity == Affinity_PhysicalCores)
+    {
+        state.cpus = get_physical_cpus(allocator());
+
+        // Only keep cores in the given set if there is one
+        if (cpus.size() > 0)
+        {
+            auto const not_given = [&](i32 const cpu) {
+                return std::find(begin(cpus), end(cpus), cpu) == end(cpus);
+            };
+
+            state.cpus.erase(
+                std::remove_if(state.cpus.begin(), state.cpus.end(), not_given),
+                state.cpus.end());
+        }
+    }
+    else
+    {
+        state.cpus.assign(begin(cpus), end(cpus));
+    }
+}
+
+void WorkerPool::set_name(char const* const name)
+{
+    assert(name != nullptr);
+    std::snprintf(state_->name, sizeof(state_->name), "%s", name);
+}
+
+isize WorkerPool::num_physical_cores()
+{
+    isize const n = static_cast<isize>(get_physical_cpus({}).size());
+    return (n > 0) ? n : std::max<isize>(std::thread::hardware_concurrency(), 1);
+}
 
+isize WorkerPool::default_num_workers() { return std::max<isize>(num_physical_cores() - 1, 1); }
+
+isize WorkerPool::num_workers() const
+{
+    return state_->num_active.load(std::memory_order_relaxed);
+}
+
+bool WorkerPool::run_pending_task() { return state_->try_run_task(state_->local_worker()); }
+
+Allocator WorkerPool::scratch_allocator()
+{
+    State::Worker* const self = State::this_worker;
+    return (self) ? Allocator{&self->scratch} : Allocator{};
+}
+
+void WorkerPool::parallel_for(
+    isize const begin,
+    isize const end,
+    isize const grain,
+    isize const max_participants,
+    RangeFnRef const& fn)
+{
+    assert(grain > 0);
+    assert(max_participants > 0);
+
+    if (begin >= end)
+        return;
+
+    struct Range
+    {
+        RangeFnRef const& fn;
+        isize end;
+        isize grain;
+        isize num_participants;
+        std::atomic<isize> next;
+        std::atomic<isize> num_joined;
+        std::atomic<isize> num_helpers;
+
+        /// Claims the next subrange. Subranges shrink as the remaining range is consumed to keep
+        /// participants busy until the end.
+        bool claim(isize& i0, isize& i1)
+        {
+            isize i = next.load(std::memory_order_relaxed);
+
+            while (i < end)
+            {
+                isize const size = std::max((end - i) / (2 * num_participants), grain);
+                isize const j = std::min(i + size, end);
+
+                if (next.compare_exchange_weak(i, j, std::memory_order_relaxed))
+                {
+                    i0 = i;
+                    i1 = j;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void run(isize const participant)
+        {
+            isize i0, i1;
+            while (claim(i0, i1))
+                fn(participant, i0, i1);
+        }
+
+        /// Invoked by helper tasks
+        void operator()()
+        {
+            run(num_joined.fetch_add(1, std::memory_order_relaxed));
+
+            // NOTE: The range can go out of scope as soon as the last helper is done
+            num_helpers.fetch_sub(1, std::memory_order_release);
+        }
+    };
+
+    // Only enlist as many helpers as there are workers and chunks to go around
+    isize const num_chunks = (end - begin + grain - 1) / grain;
+    isize const num_helpers = std::min({num_workers(), max_participants - 1, num_chunks - 1});
+
+    Range range{fn, end, grain, num_helpers + 1, {begin}, {1}, {num_helpers}};
+
+    for (isize i = 0; i < num_helpers; ++i)
+        submit(&range);
+
+    // Calling thread participates then helps out with other pending tasks until helpers are done
+    range.run(0);
+
+    help_while([&]() { return range.num_helpers.load(std::memory_order_acquire) > 0; });
+}
+
+#ifdef DR_APP_TASK_STATS
+
+WorkerPool::Stats WorkerPool::stats() const
+{
+    Stats result{};
+
+    for (isize i = 0; i < _Priority_Count; ++i)
+        result.num_queued += state_->num_tasks[i].load(std::memory_order_relaxed);
+
+    isize const num_slots = state_->num_slots.load(std::memory_order_acquire);
+
+    for (isize i = 0; i < num_slots; ++i)
+        result.num_queued += state_->slots[i].load(std::memory_order_relaxed)->tasks.size();
+
+    result.num_sleeping = state_->idle.num_waiters();
+    result.elapsed_time = task_stats_now() - state_->stats_start_time.load();
+    return result;
+}
+
+WorkerPool::WorkerStats WorkerPool::worker_stats(isize const index) const
+{
+    assert(index >= 0 && index < num_workers());
+    State::Worker const& worker = *state_->slots[index].load(std::memory_order_relaxed);
+
+    WorkerStats result{};
+    result.num_tasks = worker.num_tasks.load(std::memory_order_relaxed);
+    result.num_steals = worker.num_steals.load(std::memory_order_relaxed);
+    result.busy_time = worker.busy_time.load(std::memory_order_relaxed);
+
+    u64 const elapsed_time = task_stats_now() - state_->stats_start_time.load();
+    result.utilization = (elapsed_time > 0) ? f64(result.busy_time) / f64(elapsed_time) : 0.0;
+    return result;
+}
+
+void WorkerPool::reset_stats()
+{
+    for (auto& worker : state_->workers)
     {
-        std::scoped_lock const lock{state.mutex};
-        state.tasks.push_back(task);
+        worker.num_tasks.store(0);
+        worker.num_steals.store(0);
+        worker.busy_time.store(0);
     }
-    state.condition.notify_one();
+
+    state_->stats_start_time.store(task_stats_now());
+}
+
+#endif
+
+WorkerPool& ThreadPool::instance()
+{
+    static WorkerPool pool{};
+    return pool;
 }
 
 } // namespace dr
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include <utest.h>
+
+#include <atomic>
+#include <limits>
+#include <thread>
+
+#include <dr/app/coro.hpp>
+#include <dr/app/task_queue.hpp>
+#include <dr/app/thread_pool.hpp>
+
+namespace
+{
+
+struct Load
+{
+    std::thread::id read_thread;
+    std::thread::id upload_thread;
+    dr::isize size;
+    bool is_done;
+};
+
+dr::Coro load(dr::WorkerPool& pool, dr::TaskQueue& queue, Load& result)
+{
+    co_await dr::resume_on(pool);
+    result.read_thread = std::this_thread::get_id();
+    result.size = 4;
+
+    co_await dr::resume_on(pool);
+    result.size *= result.size;
+
+    co_await dr::resume_on(queue);
+    result.upload_thread = std::this_thread::get_id();
+    result.is_done = true;
+}
+
+} // namespace
+
+UTEST(coro, resume_on)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(2);
+
+    TaskQueue queue{pool};
+
+    constexpr isize num_loads = 100;
+    Load loads[num_loads]{};
+
+    for (auto& l : loads)
+        load(pool, queue, l);
+
+    // Coroutines should only finish on the polling thread
+    auto const is_pending = [&]() {
+        for (auto const& l : loads)
+        {
+            if (!l.is_done)
+                return true;
+        }
+
+        return false;
+    };
+
+    // NOTE: Calling thread doesn't help so the other steps always run on workers
+    while (is_pending())
+    {
+        queue.poll();
+        std::this_thread::yield();
+    }
+
+    for (auto const& l : loads)
+    {
+        ASSERT_TRUE(l.is_done);
+        ASSERT_EQ(16, l.size);
+        ASSERT_NE(std::this_thread::get_id(), l.read_thread);
+        ASSERT_EQ(std::this_thread::get_id(), l.upload_thread);
+    }
+}
+
+UTEST(coro, poll_budget)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(1);
+
+    TaskQueue queue{pool};
+    std::atomic<isize> count{0};
+
+    auto const step = [](TaskQueue& queue, std::atomic<isize>& count) -> Coro {
+        co_await resume_on(queue);
+        count.fetch_add(1);
+    };
+
+    for (isize i = 0; i < 4; ++i)
+        step(queue, count);
+
+    // Resumed coroutines should count against the event budget
+    queue.poll(std::numeric_limits<u64>::max(), 1);
+    ASSERT_EQ(1, count.load());
+
+    queue.poll(std::numeric_limits<u64>::max(), 2);
+    ASSERT_EQ(3, count.load());
+
+    // Cancelled coroutines should be destroyed without resuming
+    step(queue, count);
+    queue.cancel_all();
+    queue.wait();
+    ASSERT_EQ(3, count.load());
+    ASSERT_EQ(0, queue.size());
+}
+
+UTEST(coro, frame_pool)
+{
+    using namespace dr;
+
+    // Freed frames should be reused
+    void* const a = alloc_coro_frame(100);
+    free_coro_frame(a, 100);
+
+    void* const b = alloc_coro_frame(120);
+    ASSERT_EQ(a, b);
+    free_coro_frame(b, 120);
+
+    // Large frames should fall back to the default allocator
+    void* const c = alloc_coro_frame(isize{1} << 16);
+    ASSERT_NE(nullptr, c);
+    free_coro_frame(c, isize{1} << 16);
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <utest.h>
+
+#include <atomic>
+
+#include <dr/defer.hpp>
+#include <dr/dynamic_array.hpp>
+
+#include <dr/app/task_group.hpp>
+#include <dr/app/thread_pool.hpp>
+
+UTEST(task_group, wait)
+{
+    using namespace dr;
+
+    ThreadPool::start(4);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    TaskGroup group{};
+    std::atomic<isize> count{0};
+
+    // Tasks spawn children into the same group
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+    auto const spawn = [&]() -> void {
+        for (isize i = 0; i < 10; ++i)
+            group.run(&increment);
+    };
+
+    for (isize i = 0; i < 10; ++i)
+        group.run(&spawn);
+
+    group.wait();
+
+    ASSERT_TRUE(group.is_idle());
+    ASSERT_EQ(100, count.load());
+}
+
+UTEST(task_group, then)
+{
+    using namespace dr;
+
+    ThreadPool::start(4);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    constexpr isize num_items = 100;
+
+    struct Item
+    {
+        isize value;
+        void operator()() { value = value * 2 + 1; }
+    };
+
+    DynamicArray<Item> items(num_items);
+    for (isize i = 0; i < num_items; ++i)
+        items[i].value = i;
+
+    TaskGroup decode{};
+    TaskGroup process{};
+
+    std::atomic<isize> sum{-1};
+
+    // Each stage is kicked off by the continuation of the previous one
+    auto const pack = [&]() -> void {
+        isize result = 0;
+        for (auto const& item : items)
+            result += item.value;
+
+        sum.store(result);
+    };
+
+    auto const start_process = [&]() -> void {
+        for (auto& item : items)
+            process.run(&item);
+
+        process.then(&pack);
+    };
+
+    for (auto& item : items)
+        decode.run(&item);
+
+    decode.then(&start_process);
+
+    ThreadPool::help_while([&]() { return sum.load() < 0; });
+
+    // Each item is transformed twice: (2 * (2 * i + 1) + 1)
+    ASSERT_EQ(4 * (num_items * (num_items - 1) / 2) + 3 * num_items, sum.load());
+}
+
+UTEST(task_group, then_idle)
+{
+    using namespace dr;
+
+    ThreadPool::start(1);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    std::atomic<bool> done{false};
+    auto const finish = [&]() -> void { done.store(true); };
+
+    // Continuation should be submitted immediately if the group is idle
+    TaskGroup group{};
+    group.then(&finish);
+
+    ThreadPool::help_while([&]() { return !done.load(); });
+    ASSERT_TRUE(group.is_idle());
+}
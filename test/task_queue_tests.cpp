@@ -1,5 +1,12 @@
 #include <utest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <thread>
+
 #include <dr/defer.hpp>
 #include <dr/memory.hpp>
 
@@ -55,6 +62,977 @@ UTEST(task_queue, poll_barrier)
     ASSERT_EQ(-64, x);
 }
 
+UTEST(task_queue, wait)
+{
+    using namespace dr;
+
+    ThreadPool::start(1);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    isize x = 2;
+    auto const square_x = [&]() -> void { x *= x; };
+    auto const negate_x = [&]() -> void { x = -x; };
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    TaskQueue queue{};
+    queue.push(&square_x);
+    queue.barrier();
+    queue.push(&negate_x);
+    queue.barrier();
+
+    for (isize i = 0; i < 100; ++i)
+        queue.push(&increment);
+
+    // Calling thread should help run tasks until the queue is empty
+    queue.wait();
+
+    ASSERT_EQ(0, queue.size());
+    ASSERT_EQ(-4, x);
+    ASSERT_EQ(100, count.load());
+}
+
+UTEST(task_queue, poll_completion_order)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(4);
+
+    // Blocks until opened
+    struct Gate
+    {
+        std::atomic<bool> is_open;
+
+        void operator()() const
+        {
+            while (!is_open.load())
+                std::this_thread::yield();
+        }
+    };
+
+    struct Context
+    {
+        void* order[4];
+        isize num_completed;
+    };
+
+    auto const on_poll = [](TaskQueue::PollEvent const& event) -> bool {
+        auto ctx = static_cast<Context*>(event.context);
+
+        if (event.type == TaskQueue::PollEvent::AfterComplete)
+            ctx->order[ctx->num_completed++] = event.task;
+
+        return true;
+    };
+
+    Gate gates[4]{};
+    Context ctx{};
+
+    TaskQueue queue{pool};
+    for (auto& gate : gates)
+        queue.push(&gate, &ctx, on_poll);
+
+    // Completion events should be raised in the order tasks complete rather than the order they
+    // were pushed
+    for (isize i = 3; i >= 0; --i)
+    {
+        gates[i].is_open = true;
+        while (ctx.num_completed < 4 - i)
+            queue.poll();
+    }
+
+    ASSERT_EQ(0, queue.size());
+
+    for (isize i = 0; i < 4; ++i)
+        ASSERT_EQ(static_cast<void*>(&gates[3 - i]), ctx.order[i]);
+}
+
+UTEST(task_queue, poll_budget)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(1);
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    struct Context
+    {
+        isize index;
+        isize* num_completed;
+        bool is_in_order;
+    };
+
+    auto const on_poll = [](TaskQueue::PollEvent const& event) -> bool {
+        auto ctx = static_cast<Context*>(event.context);
+
+        if (event.type == TaskQueue::PollEvent::AfterComplete)
+            ctx->is_in_order = (ctx->index == (*ctx->num_completed)++);
+
+        return true;
+    };
+
+    isize num_completed{0};
+    Context ctxs[13]{};
+
+    for (isize i = 0; i < 13; ++i)
+        ctxs[i] = {i, &num_completed, false};
+
+    TaskQueue queue{pool};
+
+    for (isize i = 0; i < 10; ++i)
+        queue.push(&increment, &ctxs[i], on_poll);
+
+    queue.barrier();
+    queue.push(&increment);
+
+    // Wait for the first batch to complete
+    queue.poll();
+    while (count.load() < 10)
+        std::this_thread::yield();
+
+    // Completion events should be spread across polls
+    for (isize i = 0; i < 3; ++i)
+    {
+        queue.poll(std::numeric_limits<u64>::max(), 4);
+        ASSERT_EQ(std::min<isize>(4 * (i + 1), 10), num_completed);
+
+        // Task after the barrier shouldn't be submitted until all events have been raised
+        ASSERT_EQ(i < 2, queue.size() > 1);
+    }
+
+    queue.wait();
+
+    for (isize i = 10; i < 13; ++i)
+        queue.push(&increment, &ctxs[i], on_poll);
+
+    queue.poll();
+    while (count.load() < 14)
+        std::this_thread::yield();
+
+    // Should still raise one event per poll without any time to spare
+    for (isize i = 0; i < 3; ++i)
+    {
+        queue.poll(0);
+        ASSERT_EQ(11 + i, num_completed);
+    }
+
+    for (auto const& ctx : ctxs)
+        ASSERT_TRUE(ctx.is_in_order);
+}
+
+UTEST(task_queue, max_in_flight)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(4);
+
+    // Tracks the peak number of tasks running at once
+    struct Tracker
+    {
+        std::atomic<isize> num_running;
+        std::atomic<isize> max_running;
+
+        void operator()()
+        {
+            isize const n = num_running.fetch_add(1) + 1;
+
+            isize max = max_running.load();
+            while (n > max && !max_running.compare_exchange_weak(max, n))
+                ;
+
+            std::this_thread::sleep_for(std::chrono::microseconds{100});
+            num_running.fetch_sub(1);
+        }
+    };
+
+    {
+        Tracker tracker{};
+        TaskQueue queue{pool};
+        queue.set_max_in_flight(2);
+
+        for (isize i = 0; i < 20; ++i)
+            queue.push(&tracker);
+
+        while (queue.size() > 0)
+        {
+            queue.poll();
+            ASSERT_LE(queue.num_in_flight(), 2);
+        }
+
+        ASSERT_LE(tracker.max_running.load(), 2);
+    }
+
+    {
+        Tracker tracker{};
+        TaskQueue queue{pool};
+        queue.set_max_in_flight(TaskQueue::max_in_flight_count, 10);
+
+        // Should only fit one expensive task at a time
+        for (isize i = 0; i < 10; ++i)
+            queue.push(&tracker, nullptr, nullptr, WorkerPool::Priority_Normal, 6);
+
+        // Tasks over the limit should still be submitted one at a time
+        queue.push(&tracker, nullptr, nullptr, WorkerPool::Priority_Normal, 20);
+
+        while (queue.size() > 0)
+        {
+            queue.poll();
+            ASSERT_LE(queue.num_in_flight(), 1);
+        }
+
+        ASSERT_EQ(1, tracker.max_running.load());
+        ASSERT_EQ(0, queue.in_flight_cost());
+    }
+}
+
+UTEST(task_queue, handle)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(1);
+
+    std::atomic<bool> is_blocked{true};
+    std::atomic<bool> is_started{false};
+    auto const block = [&]() -> void {
+        is_started = true;
+        while (is_blocked.load())
+            std::this_thread::yield();
+    };
+
+    isize x = 2;
+    auto const square_x = [&]() -> void { x *= x; };
+
+    TaskQueue queue{pool};
+    ASSERT_FALSE(TaskHandle{}.is_valid());
+
+    // NOTE: Blocking task needs to start on the worker before the calling thread helps out
+    TaskHandle const b = queue.push(&block);
+    queue.poll();
+    while (!is_started.load())
+        std::this_thread::yield();
+
+    TaskHandle const a = queue.push(&square_x);
+    ASSERT_TRUE(a.is_valid());
+    ASSERT_FALSE(queue.is_done(a));
+
+    // Should only wait on the given task
+    queue.wait(a);
+    ASSERT_TRUE(queue.is_done(a));
+    ASSERT_FALSE(queue.is_done(b));
+    ASSERT_EQ(4, x);
+
+    // Handle should stay done after its slot is reused
+    TaskHandle const c = queue.push(&square_x);
+    ASSERT_TRUE(queue.is_done(a));
+    ASSERT_FALSE(queue.is_done(c));
+
+    is_blocked = false;
+    queue.wait();
+    ASSERT_TRUE(queue.is_done(b));
+    ASSERT_TRUE(queue.is_done(c));
+    ASSERT_EQ(16, x);
+}
+
+UTEST(task_queue, dependencies)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(2);
+
+    std::atomic<bool> is_blocked{true};
+    std::atomic<isize> num_started{0};
+    auto const block = [&]() -> void {
+        num_started.fetch_add(1);
+        while (is_blocked.load())
+            std::this_thread::yield();
+    };
+
+    std::atomic<isize> x{2};
+    auto const square_x = [&]() -> void { x = x * x; };
+    auto const negate_x = [&]() -> void { x = -x; };
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    TaskQueue queue{pool};
+    TaskHandle const a = queue.push(&block);
+    TaskHandle const b = queue.push(&square_x, {&a, 1});
+    TaskHandle const c = queue.push(&negate_x, {&b, 1});
+
+    // NOTE: Blocking task needs to start on a worker before the calling thread helps out
+    queue.poll();
+    while (num_started.load() < 1)
+        std::this_thread::yield();
+
+    TaskHandle const d = queue.push(&increment);
+
+    // Independent task shouldn't wait on the blocked chain
+    queue.wait(d);
+    ASSERT_EQ(1, count.load());
+    ASSERT_FALSE(queue.is_done(b));
+    ASSERT_EQ(2, x.load());
+
+    // Barrier should wait on tasks that were set aside
+    queue.barrier();
+    queue.push(&increment);
+    queue.poll();
+    ASSERT_EQ(1, count.load());
+
+    is_blocked = false;
+    queue.wait(c);
+    ASSERT_EQ(-4, x.load());
+
+    queue.wait();
+    ASSERT_EQ(2, count.load());
+
+    // Dependencies that are already done should be ignored
+    TaskHandle const deps[] = {a, TaskHandle{}};
+    queue.push(&negate_x, {deps, 2});
+    queue.wait();
+    ASSERT_EQ(4, x.load());
+
+    // Cancelling a task that was set aside should let its dependents go ahead
+    is_blocked = true;
+    isize y = 0;
+    TaskHandle const e = queue.push(&block);
+    TaskHandle const f = queue.push(&negate_x, {&e, 1}, &y);
+    queue.push(&increment, {&f, 1});
+
+    queue.poll();
+    while (num_started.load() < 2)
+        std::this_thread::yield();
+
+    queue.cancel(&y);
+    ASSERT_TRUE(queue.is_done(f));
+
+    is_blocked = false;
+    queue.wait();
+    ASSERT_EQ(4, x.load());
+    ASSERT_EQ(3, count.load());
+}
+
+UTEST(task_queue, push_concurrent)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(2);
+
+    TaskQueue queue{pool};
+    std::atomic<isize> count{0};
+
+    // Each task pushes follow-up tasks from the worker it runs on
+    struct Spawn
+    {
+        TaskQueue* queue;
+        std::atomic<isize>* count;
+        isize depth;
+        Spawn* children;
+
+        void operator()() const
+        {
+            count->fetch_add(1);
+            if (depth > 0)
+            {
+                queue->push_concurrent(&children[0]);
+                queue->push_concurrent(&children[1]);
+            }
+        }
+    };
+
+    constexpr isize depth = 8;
+    constexpr isize num_nodes = (isize{1} << (depth + 1)) - 1;
+    Spawn nodes[num_nodes];
+
+    for (isize i = 0; i < num_nodes; ++i)
+    {
+        isize const node_depth = [&]() {
+            isize d = depth;
+            for (isize n = i + 1; n > 1; n >>= 1)
+                --d;
+            return d;
+        }();
+
+        nodes[i] = {&queue, &count, node_depth, nodes + 2 * i + 1};
+    }
+
+    queue.push(&nodes[0]);
+    queue.wait();
+    ASSERT_EQ(num_nodes, count.load());
+    ASSERT_EQ(0, queue.size());
+
+    // Tasks can also be pushed from threads outside of the pool
+    count = 0;
+    std::thread producers[2];
+    for (auto& producer : producers)
+    {
+        producer = std::thread{[&]() {
+            for (isize i = 0; i < 100; ++i)
+                queue.push_concurrent(&nodes[num_nodes - 1]);
+        }};
+    }
+
+    for (auto& producer : producers)
+        producer.join();
+
+    queue.wait();
+    ASSERT_EQ(200, count.load());
+
+    // Dependencies that haven't been picked up by poll yet should be queued ahead of barriers
+    count = 0;
+    TaskHandle const y = queue.push_concurrent(&nodes[num_nodes - 1]);
+    queue.push(&nodes[num_nodes - 1], {&y, 1});
+    queue.barrier();
+    queue.push(&nodes[num_nodes - 1]);
+    queue.wait();
+    ASSERT_EQ(3, count.load());
+
+    // Cancelling should include tasks that haven't been picked up by poll yet
+    isize x = 0;
+    TaskHandle const h = queue.push_concurrent(&nodes[0], &x);
+    queue.cancel(&x);
+    ASSERT_TRUE(queue.is_done(h));
+    ASSERT_EQ(0, queue.size());
+    ASSERT_EQ(3, count.load());
+}
+
+UTEST(task_queue, push_owned)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(2);
+
+    TaskQueue queue{pool};
+    auto const data = std::make_shared<isize>(1);
+
+    // Owned tasks should be kept alive until handled by poll
+    isize count = 0;
+    auto const on_event = [](TaskQueue::PollEvent const& event) -> bool {
+        if (event.type != TaskQueue::PollEvent::BeforeSubmit)
+            ++*static_cast<isize*>(event.context);
+
+        return true;
+    };
+
+    std::atomic<isize> num_loaded{0};
+    for (isize i = 0; i < 100; ++i)
+        queue.push([data, &num_loaded]() { num_loaded.fetch_add(*data); }, &count, on_event);
+
+    TaskHandle const h = queue.push_concurrent([&num_loaded]() { num_loaded.fetch_add(1); });
+    queue.push([]() {}, {&h, 1});
+
+    queue.wait();
+    ASSERT_EQ(101, num_loaded.load());
+    ASSERT_EQ(100, count);
+    ASSERT_EQ(1, data.use_count());
+
+    // Cancelled tasks should be destroyed without running
+    queue.barrier();
+    queue.push([data, &num_loaded]() { num_loaded.fetch_add(*data); }, &count, on_event);
+    ASSERT_EQ(2, data.use_count());
+
+    queue.cancel(&count);
+    ASSERT_EQ(1, data.use_count());
+
+    queue.wait();
+    ASSERT_EQ(101, num_loaded.load());
+    ASSERT_EQ(101, count);
+}
+
+UTEST(task_queue, push_result)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(2);
+
+    TaskQueue queue{pool};
+
+    isize x = 3;
+    TaskFuture<isize> a = queue.push_result([&x]() { return x * x; });
+    TaskFuture<isize> b = queue.push_result([]() { return isize{-1}; });
+
+    // Results should be available once tasks are done
+    a.wait();
+    ASSERT_TRUE(a.is_ready());
+    ASSERT_EQ(9, *a.get());
+
+    // Results should stay available after the queue is empty
+    queue.wait();
+    ASSERT_EQ(0, queue.size());
+    ASSERT_EQ(-1, *b.get());
+
+    // Tasks with results can have dependencies
+    TaskFuture<isize> c = queue.push_result([&x]() { return ++x; });
+    TaskFuture<isize> d = queue.push_result([&x]() { return x * 2; }, {&c.handle(), 1});
+    d.wait();
+    ASSERT_TRUE(c.is_ready());
+    ASSERT_EQ(4, *c.get());
+    ASSERT_EQ(8, *d.get());
+
+    // Results should be destroyed once futures are reset
+    auto const data = std::make_shared<isize>(4);
+    TaskFuture<std::shared_ptr<isize>> e = queue.push_result([data]() { return data; });
+    e.wait();
+    ASSERT_EQ(3, data.use_count());
+
+    TaskHandle const e_handle = e.handle();
+    TaskFuture<std::shared_ptr<isize>> f = std::move(e);
+    ASSERT_FALSE(e.is_valid());
+    f.reset();
+    ASSERT_EQ(1, data.use_count());
+    ASSERT_TRUE(queue.is_done(e_handle));
+
+    // Futures reset before tasks are done shouldn't keep slots around
+    {
+        TaskFuture<std::shared_ptr<isize>> g = queue.push_result([data]() { return data; });
+    }
+    queue.wait();
+    ASSERT_EQ(1, data.use_count());
+
+    // Cancelled tasks shouldn't have a result
+    isize y = 0;
+    queue.barrier();
+    TaskFuture<isize> h = queue.push_result([]() { return isize{1}; }, &y);
+    queue.cancel(&y);
+    ASSERT_TRUE(h.is_ready());
+    ASSERT_EQ(nullptr, h.get());
+
+    // Tasks cancelled after they ran shouldn't have a result either
+    TaskFuture<std::shared_ptr<isize>> i = queue.push_result([data]() { return data; }, &y);
+    queue.poll();
+    while (data.use_count() < 3)
+        std::this_thread::yield();
+
+    queue.cancel(&y);
+    i.wait();
+    ASSERT_EQ(nullptr, i.get());
+
+    i.reset();
+    ASSERT_EQ(1, data.use_count());
+}
+
+UTEST(task_queue, post)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(1);
+
+    TaskQueue queue{pool};
+
+    isize count = 0;
+    auto const on_event = [](TaskQueue::PollEvent const& event) -> bool {
+        if (event.type == TaskQueue::PollEvent::AfterComplete)
+            ++*static_cast<isize*>(event.context);
+
+        return true;
+    };
+
+    // Events posted from a worker should be raised on the polling thread
+    std::atomic<bool> is_posted{false};
+    auto const post = [&]() -> void {
+        queue.post(&count, on_event);
+        is_posted = true;
+    };
+
+    queue.push(&post);
+    queue.wait();
+    ASSERT_TRUE(is_posted.load());
+    ASSERT_EQ(1, count);
+
+    // Posted events should be counted by size once collected by poll
+    TaskHandle const h = queue.post(&count, on_event);
+    ASSERT_FALSE(queue.is_done(h));
+    queue.poll();
+    ASSERT_TRUE(queue.is_done(h));
+    ASSERT_EQ(2, count);
+    ASSERT_EQ(0, queue.size());
+}
+
+UTEST(task_queue, scheduled)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(1);
+
+    TaskQueue queue{pool};
+
+    std::atomic<isize> num_delayed{0};
+    auto const delayed = [&]() -> void { num_delayed.fetch_add(1); };
+
+    std::atomic<isize> num_periodic{0};
+    auto const periodic = [&]() -> void { num_periodic.fetch_add(1); };
+
+    queue.set_time(100);
+    queue.push_at(&delayed, 150);
+    queue.push_at(&delayed, 120);
+    TaskHandle const h = queue.push_periodic(&periodic, 10);
+    ASSERT_EQ(3, queue.num_scheduled());
+    ASSERT_EQ(0, queue.size());
+
+    // Tasks shouldn't be queued before they're due
+    queue.set_time(109);
+    queue.wait();
+    ASSERT_EQ(0, num_periodic.load());
+
+    queue.set_time(110);
+    queue.wait();
+    ASSERT_EQ(1, num_periodic.load());
+    ASSERT_EQ(0, num_delayed.load());
+    ASSERT_EQ(3, queue.num_scheduled());
+
+    queue.set_time(125);
+    queue.wait();
+    ASSERT_EQ(1, num_delayed.load());
+
+    // Periodic tasks should repeat while missed periods are skipped
+    queue.poll();
+    ASSERT_EQ(2, num_periodic.load());
+
+    queue.set_time(162);
+    queue.wait();
+    queue.poll();
+    ASSERT_EQ(2, num_delayed.load());
+    ASSERT_EQ(3, num_periodic.load());
+    ASSERT_EQ(1, queue.num_scheduled());
+
+    queue.set_time(169);
+    queue.poll();
+    ASSERT_EQ(3, num_periodic.load());
+
+    queue.set_time(170);
+    queue.wait();
+    ASSERT_EQ(4, num_periodic.load());
+    ASSERT_FALSE(queue.is_done(h));
+
+    // Waiting on a periodic task should only wait on its current run
+    queue.set_time(180);
+    queue.wait(h);
+    ASSERT_EQ(5, num_periodic.load());
+    ASSERT_FALSE(queue.is_done(h));
+
+    queue.wait(h);
+    ASSERT_EQ(5, num_periodic.load());
+
+    // Cancelled periodic tasks shouldn't be scheduled again
+    queue.cancel_all();
+    ASSERT_TRUE(queue.is_done(h));
+    ASSERT_EQ(0, queue.num_scheduled());
+
+    queue.set_time(1000);
+    queue.wait();
+    ASSERT_EQ(5, num_periodic.load());
+
+    // Delayed tasks can be dependencies once they're due
+    TaskHandle const d = queue.push_at(&delayed, 1010);
+    queue.set_time(1010);
+    queue.poll();
+
+    queue.push(&delayed, {&d, 1});
+    queue.barrier();
+    queue.push(&delayed);
+    queue.wait();
+    ASSERT_EQ(5, num_delayed.load());
+
+    // Scheduled and periodic tasks should be rejected as dependencies
+    TaskHandle const s = queue.push_at(&delayed, 2000);
+    TaskHandle const p = queue.push_periodic(&periodic, 10);
+
+    ASSERT_FALSE(queue.push(&delayed, {&s, 1}).is_valid());
+    ASSERT_FALSE(queue.push(&delayed, {&p, 1}).is_valid());
+    ASSERT_FALSE(queue.push_result([]() -> isize { return 1; }, {&p, 1}).is_valid());
+    ASSERT_EQ(0, queue.size());
+
+    queue.cancel_all();
+    queue.wait();
+    ASSERT_EQ(5, num_delayed.load());
+}
+
+UTEST(task_queue, dependencies_cancelled)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(2);
+
+    std::atomic<isize> num_started{0};
+
+    std::atomic<bool> is_a_blocked{true};
+    auto const block_a = [&]() -> void {
+        num_started.fetch_add(1);
+        while (is_a_blocked.load())
+            std::this_thread::yield();
+    };
+
+    std::atomic<bool> is_e_blocked{true};
+    auto const block_e = [&]() -> void {
+        num_started.fetch_add(1);
+        while (is_e_blocked.load())
+            std::this_thread::yield();
+    };
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    TaskQueue queue{pool};
+    auto _ = defer([&]() {
+        is_a_blocked = false;
+        is_e_blocked = false;
+    });
+
+    isize y = 0;
+    TaskHandle const a = queue.push(&block_a);
+    queue.push(&increment, {&a, 1}, &y);
+    TaskHandle const e = queue.push(&block_e);
+
+    // NOTE: Blocking tasks need to start on workers before the calling thread helps out
+    queue.poll();
+    while (num_started.load() < 2)
+        std::this_thread::yield();
+
+    queue.cancel(&y);
+
+    // Reused slot shouldn't be affected by dependency links left by the cancelled task
+    TaskHandle const deps[] = {a, e};
+    queue.push(&increment, {deps, 2});
+
+    is_a_blocked = false;
+    queue.wait(a);
+
+    // NOTE: Gives a worker time to pick up the dependent if it was wrongly submitted
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    queue.poll();
+    ASSERT_EQ(0, count.load());
+    ASSERT_EQ(1, queue.num_in_flight());
+
+    is_e_blocked = false;
+    queue.wait();
+    ASSERT_EQ(1, count.load());
+}
+
+UTEST(task_queue, poll_callback_changes)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(1);
+
+    TaskQueue queue{pool};
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    struct Context
+    {
+        TaskQueue* queue;
+        TaskRef task;
+        void* cancel_context;
+        isize num_cancelled;
+    };
+
+    // Callbacks push and cancel tasks while the queue is iterating over its own
+    auto const on_poll = [](TaskQueue::PollEvent const& event) -> bool {
+        auto ctx = static_cast<Context*>(event.context);
+
+        if (event.type == TaskQueue::PollEvent::BeforeSubmit)
+        {
+            for (isize i = 0; i < 10; ++i)
+                ctx->queue->push(ctx->task);
+
+            ctx->queue->barrier();
+        }
+        else if (event.type == TaskQueue::PollEvent::AfterComplete)
+        {
+            ctx->queue->cancel(ctx->cancel_context);
+        }
+        else if (event.type == TaskQueue::PollEvent::Cancelled)
+        {
+            ++ctx->num_cancelled;
+            ctx->queue->push(ctx->task);
+        }
+
+        return true;
+    };
+
+    Context ctx_b{&queue, &increment, nullptr, 0};
+    Context ctx_a{&queue, &increment, &ctx_b, 0};
+
+    // NOTE: Enough tasks are pushed for the queue to grow its storage while it's iterating
+    for (isize i = 0; i < 100; ++i)
+        queue.push(&increment, &ctx_a, on_poll);
+
+    queue.barrier();
+
+    for (isize i = 0; i < 10; ++i)
+        queue.push(&increment, &ctx_b, on_poll);
+
+    // Tasks behind the barrier should be cancelled once tasks in front complete while tasks
+    // pushed from callbacks are still run
+    queue.wait();
+    ASSERT_EQ(0, ctx_a.num_cancelled);
+    ASSERT_EQ(10, ctx_b.num_cancelled);
+    ASSERT_EQ(1110, count.load());
+}
+
+UTEST(task_queue, thread_pool)
+{
+    using namespace dr;
+
+    // Queue should submit to the given pool rather than the default instance
+    WorkerPool pool{};
+    pool.start(1);
+
+    isize x = 2;
+    auto const square_x = [&]() -> void { x *= x; };
+
+    TaskQueue queue{pool};
+    ASSERT_EQ(&pool, &queue.thread_pool());
+
+    queue.push(&square_x);
+    queue.wait();
+
+    ASSERT_EQ(0, ThreadPool::num_workers());
+    ASSERT_EQ(4, x);
+}
+
+UTEST(task_queue, cancel)
+{
+    using namespace dr;
+
+    ThreadPool::start(1);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    // Blocks the worker until cancelled
+    std::atomic<bool> is_started{false};
+    auto const block = [&]() -> void {
+        is_started.store(true);
+
+        CancelToken const token = TaskQueue::cancel_token();
+        while (!token.is_requested())
+            std::this_thread::yield();
+    };
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    struct Context
+    {
+        isize num_completed;
+        isize num_cancelled;
+    };
+
+    auto const on_poll = [](TaskQueue::PollEvent const& event) -> bool {
+        auto ctx = static_cast<Context*>(event.context);
+
+        if (event.type == TaskQueue::PollEvent::AfterComplete)
+            ++ctx->num_completed;
+        else if (event.type == TaskQueue::PollEvent::Cancelled)
+            ++ctx->num_cancelled;
+
+        return true;
+    };
+
+    Context ctx_a{};
+    Context ctx_b{};
+
+    TaskQueue queue{};
+    queue.push(&block, &ctx_a, on_poll);
+
+    for (isize i = 0; i < 10; ++i)
+        queue.push(&increment, &ctx_a, on_poll);
+
+    queue.barrier();
+
+    for (isize i = 0; i < 10; ++i)
+        queue.push(&increment, &ctx_b, on_poll);
+
+    // Submit the first batch and wait for the blocking task to start
+    queue.poll();
+    while (!is_started.load())
+        std::this_thread::yield();
+
+    // Should cancel both submitted and queued tasks
+    queue.cancel(&ctx_a);
+    queue.wait();
+
+    ASSERT_EQ(0, ctx_a.num_completed);
+    ASSERT_EQ(11, ctx_a.num_cancelled);
+    ASSERT_EQ(10, ctx_b.num_completed);
+    ASSERT_EQ(0, ctx_b.num_cancelled);
+    ASSERT_EQ(10, count.load());
+
+    // Unsubmitted tasks should be removed immediately
+    for (isize i = 0; i < 10; ++i)
+        queue.push(&increment, &ctx_b, on_poll);
+
+    queue.cancel_all();
+
+    ASSERT_EQ(0, queue.size());
+    ASSERT_EQ(10, ctx_b.num_cancelled);
+}
+
+UTEST(task_queue, move)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(1);
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    TaskQueue src{pool};
+    src.push(&increment);
+    src.poll();
+    src.push(&increment);
+    src.push_concurrent(&increment);
+
+    // Tasks should move along with the queue
+    TaskQueue dst{std::move(src)};
+    ASSERT_EQ(0, src.size());
+    dst.wait();
+    ASSERT_EQ(3, count.load());
+
+    // Moved-from queue should still be usable
+    src.push(&increment);
+    src.push_concurrent(&increment);
+    src.wait();
+    ASSERT_EQ(5, count.load());
+
+    // Assigning should cancel the destination's own tasks first
+    auto const on_poll = [](TaskQueue::PollEvent const& event) -> bool {
+        if (event.type == TaskQueue::PollEvent::Cancelled)
+            ++*static_cast<isize*>(event.context);
+
+        return true;
+    };
+
+    isize num_cancelled{0};
+    dst.push(&increment, &num_cancelled, on_poll);
+
+    src.push(&increment);
+    dst = std::move(src);
+    ASSERT_EQ(1, num_cancelled);
+    ASSERT_EQ(1, dst.size());
+
+    dst.wait();
+    ASSERT_EQ(6, count.load());
+
+    src.push(&increment);
+    src.wait();
+    ASSERT_EQ(7, count.load());
+}
+
 UTEST(task_queue, allocator_propagation)
 {
     using namespace dr;
@@ -82,3 +1060,34 @@ UTEST(task_queue, allocator_propagation)
         ASSERT_TRUE(src_move.allocator().resource()->is_equal(mem[1]));
     }
 }
+
+#ifdef DR_APP_TASK_STATS
+
+UTEST(task_queue, stats)
+{
+    using namespace dr;
+
+    ThreadPool::start(1);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    auto const sleep = []() -> void { std::this_thread::sleep_for(std::chrono::milliseconds{1}); };
+
+    TaskQueue queue{};
+    for (isize i = 0; i < 10; ++i)
+        queue.push(&sleep);
+
+    queue.wait();
+
+    // Each stage should be recorded once per task
+    auto const& stats = queue.stats();
+    ASSERT_EQ(u64{10}, stats.queued.count);
+    ASSERT_EQ(u64{10}, stats.submitted.count);
+    ASSERT_EQ(u64{10}, stats.running.count);
+    ASSERT_EQ(u64{10}, stats.completed.count);
+    ASSERT_EQ(10, stats.max_size);
+
+    // Run time should reflect the time spent sleeping
+    ASSERT_GE(stats.running.percentile(0.5), u64{500000});
+}
+
+#endif
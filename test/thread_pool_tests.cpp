@@ -0,0 +1,605 @@
+#include <utest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <dr/defer.hpp>
+#include <dr/dynamic_array.hpp>
+
+#include <dr/app/thread_pool.hpp>
+
+UTEST(thread_pool, submit)
+{
+    using namespace dr;
+
+    ThreadPool::start(4);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    constexpr isize num_tasks = 1000;
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    for (isize i = 0; i < num_tasks; ++i)
+        ThreadPool::submit(&increment);
+
+    while (count.load() < num_tasks)
+        ;
+
+    ASSERT_EQ(num_tasks, count.load());
+}
+
+UTEST(thread_pool, submit_nested)
+{
+    using namespace dr;
+
+    constexpr isize num_outer = 100;
+    constexpr isize num_inner = 100;
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    // Tasks submitted from workers are pushed to local deques and stolen by idle peers
+    auto const spawn = [&]() -> void {
+        for (isize i = 0; i < num_inner; ++i)
+            ThreadPool::submit(&increment);
+    };
+
+    ThreadPool::start(4);
+
+    for (isize i = 0; i < num_outer; ++i)
+        ThreadPool::submit(&spawn);
+
+    // Should finish all tasks (including those submitted during shutdown) before stopping
+    ThreadPool::stop();
+
+    ASSERT_EQ(num_outer * num_inner, count.load());
+}
+
+UTEST(thread_pool, parallel_for)
+{
+    using namespace dr;
+
+    ThreadPool::start(4);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    DynamicArray<isize> values(10000);
+
+    ThreadPool::parallel_for(0, 10000, 16, [&](isize const i0, isize const i1) {
+        for (isize i = i0; i < i1; ++i)
+            values[i] += i;
+    });
+
+    // Each index should be visited exactly once
+    for (isize i = 0; i < 10000; ++i)
+        ASSERT_EQ(i, values[i]);
+}
+
+UTEST(thread_pool, parallel_for_nested)
+{
+    using namespace dr;
+
+    ThreadPool::start(4);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    std::atomic<isize> count{0};
+
+    ThreadPool::parallel_for(0, 100, 1, [&](isize const i0, isize const i1) {
+        for (isize i = i0; i < i1; ++i)
+        {
+            ThreadPool::parallel_for(0, 100, 1, [&](isize const j0, isize const j1) {
+                count.fetch_add(j1 - j0);
+            });
+        }
+    });
+
+    ASSERT_EQ(100 * 100, count.load());
+}
+
+UTEST(thread_pool, parallel_reduce)
+{
+    using namespace dr;
+
+    // Should run serially on the calling thread if the pool isn't active
+    for (isize num_workers : {0, 1, 4})
+    {
+        if (num_workers > 0)
+            ThreadPool::start(num_workers);
+
+        auto _ = defer([]() { ThreadPool::stop(); });
+
+        isize const sum = ThreadPool::parallel_reduce(
+            1,
+            10001,
+            64,
+            isize{0},
+            [](isize const i0, isize const i1) -> isize {
+                isize result = 0;
+                for (isize i = i0; i < i1; ++i)
+                    result += i;
+
+                return result;
+            },
+            [](isize const a, isize const b) -> isize { return a + b; });
+
+        ASSERT_EQ(isize{10000 * 10001 / 2}, sum);
+    }
+}
+
+UTEST(thread_pool, submit_priority)
+{
+    using namespace dr;
+    using Clock = std::chrono::steady_clock;
+
+    ThreadPool::start(4);
+    ThreadPool::set_max_low_priority_workers(2);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    std::atomic<bool> is_released{false};
+    std::atomic<isize> num_low_running{0};
+    std::atomic<isize> max_low_running{0};
+    std::atomic<isize> num_low_done{0};
+
+    // Low priority tasks block until released
+    auto const low = [&]() -> void {
+        isize const n = num_low_running.fetch_add(1) + 1;
+
+        isize m = max_low_running.load();
+        while (m < n && !max_low_running.compare_exchange_weak(m, n))
+            ;
+
+        // NOTE: Sleeps rather than spins so blocked tasks don't compete with workers for CPU time
+        while (!is_released.load())
+            std::this_thread::sleep_for(std::chrono::microseconds{100});
+
+        num_low_running.fetch_sub(1);
+        num_low_done.fetch_add(1);
+    };
+
+    // High priority tasks record how much of the low priority backlog had drained when they ran
+    constexpr isize num_high = 8;
+    std::atomic<isize> num_high_done{0};
+    std::atomic<isize> max_low_done_before_high{0};
+
+    auto const high = [&]() -> void {
+        isize const n = num_low_done.load();
+
+        isize m = max_low_done_before_high.load();
+        while (m < n && !max_low_done_before_high.compare_exchange_weak(m, n))
+            ;
+
+        num_high_done.fetch_add(1);
+    };
+
+    constexpr isize num_low = 16;
+    for (isize i = 0; i < num_low; ++i)
+        ThreadPool::submit(&low, WorkerPool::Priority_Low);
+
+    while (num_low_running.load() < 2)
+        std::this_thread::yield();
+
+    // High priority tasks should complete while the low priority backlog is still queued
+    for (isize i = 0; i < num_high; ++i)
+        ThreadPool::submit(&high, WorkerPool::Priority_High);
+
+    // NOTE: Calling thread doesn't help so it can't pick up blocked low priority tasks. The timeout
+    // only guards against hanging if high priority tasks are starved.
+    auto const timeout = Clock::now() + std::chrono::seconds{10};
+    while (num_high_done.load() < num_high && Clock::now() < timeout)
+        std::this_thread::yield();
+
+    isize const num_high_before_release = num_high_done.load();
+    is_released.store(true);
+
+    ASSERT_EQ(num_high, num_high_before_release);
+    ASSERT_EQ(isize{0}, max_low_done_before_high.load());
+
+    ThreadPool::stop();
+    ASSERT_EQ(num_low, num_low_done.load());
+    ASSERT_LE(max_low_running.load(), isize{2});
+}
+
+UTEST(thread_pool, submit_batch)
+{
+    using namespace dr;
+
+    ThreadPool::start(4);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    constexpr isize num_tasks = 1000;
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    DynamicArray<TaskRef> tasks(num_tasks, &increment);
+    ThreadPool::submit(Span<TaskRef const>{tasks.data(), num_tasks});
+
+    // Batches submitted from workers should be split between local deques and the injection queue
+    auto const spawn = [&]() -> void {
+        ThreadPool::submit(Span<TaskRef const>{tasks.data(), num_tasks});
+    };
+
+    for (isize i = 0; i < 4; ++i)
+        ThreadPool::submit(&spawn);
+
+    ThreadPool::help_while([&]() { return count.load() < 5 * num_tasks; });
+    ASSERT_EQ(5 * num_tasks, count.load());
+}
+
+UTEST(thread_pool, submit_owned)
+{
+    using namespace dr;
+
+    ThreadPool::start(4);
+    auto _ = defer([]() { ThreadPool::stop(); });
+
+    constexpr isize num_tasks = 1000;
+
+    // Tracks live copies of captured state
+    struct Counted
+    {
+        std::atomic<isize>* num_live;
+
+        Counted(std::atomic<isize>* num_live) : num_live{num_live} { num_live->fetch_add(1); }
+        Counted(Counted const& other) : Counted{other.num_live} {}
+        ~Counted() { num_live->fetch_sub(1); }
+    };
+
+    std::atomic<isize> count{0};
+    std::atomic<isize> num_live{0};
+
+    // Small captures are stored inline while large ones fall back to the heap
+    for (isize i = 0; i < num_tasks; ++i)
+    {
+        Counted const counted{&num_live};
+
+        if (i & 1)
+        {
+            ThreadPool::submit([&count, counted]() { count.fetch_add(1); });
+        }
+        else
+        {
+            char large[UniqueTask::inline_size]{};
+            ThreadPool::submit([&count, counted, large]() { count.fetch_add(1 + large[0]); });
+        }
+    }
+
+    // Owned tasks should be destroyed once they've run
+    ThreadPool::help_while([&]() { return count.load() < num_tasks || num_live.load() > 0; });
+    ASSERT_EQ(num_tasks, count.load());
+    ASSERT_EQ(0, num_live.load());
+
+    // Slots should be recycled between workers and other threads submitting at once
+    count = 0;
+
+    auto const submit_nested = [&]() -> void {
+        for (isize i = 0; i < num_tasks; ++i)
+        {
+            ThreadPool::submit([&count]() {
+                ThreadPool::submit([&count]() { count.fetch_add(1); });
+            });
+        }
+    };
+
+    std::thread threads[2];
+    for (auto& thread : threads)
+        thread = std::thread{submit_nested};
+
+    submit_nested();
+
+    for (auto& thread : threads)
+        thread.join();
+
+    ThreadPool::help_while([&]() { return count.load() < 3 * num_tasks; });
+    ASSERT_EQ(3 * num_tasks, count.load());
+
+    // Moving a task should transfer ownership
+    UniqueTask a{[&count]() { count.fetch_add(1); }};
+    UniqueTask b{std::move(a)};
+    ASSERT_FALSE(a.is_valid());
+    ASSERT_TRUE(b.is_valid());
+
+    b();
+    ASSERT_EQ(3 * num_tasks + 1, count.load());
+
+    b.reset();
+    ASSERT_FALSE(b.is_valid());
+}
+
+UTEST(thread_pool, instances)
+{
+    using namespace dr;
+
+    WorkerPool io_pool{};
+    io_pool.start(2);
+
+    WorkerPool compute_pool{};
+    compute_pool.start(2);
+
+    // Tasks on one pool can use the other
+    std::atomic<isize> sum{0};
+    auto const load = [&]() -> void {
+        isize const result = compute_pool.parallel_reduce(
+            0,
+            100,
+            1,
+            isize{0},
+            [](isize const i0, isize const i1) -> isize { return i1 - i0; },
+            [](isize const a, isize const b) -> isize { return a + b; });
+
+        sum.fetch_add(result);
+    };
+
+    for (isize i = 0; i < 10; ++i)
+        io_pool.submit(&load);
+
+    io_pool.help_while([&]() { return sum.load() < 1000; });
+
+    // Default instance shouldn't be affected
+    ASSERT_EQ(0, ThreadPool::num_workers());
+    ASSERT_EQ(2, io_pool.num_workers());
+    ASSERT_EQ(1000, sum.load());
+}
+
+UTEST(thread_pool, scratch_allocator)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(1);
+
+    // Should fall back to the default allocator off worker threads
+    ASSERT_TRUE(WorkerPool::scratch_allocator().resource()->is_equal(*Allocator{}.resource()));
+
+    std::atomic<void*> data[2]{};
+    bool is_scratch[2]{};
+
+    auto const alloc_temp = [&](isize const index) -> void {
+        Allocator const alloc = WorkerPool::scratch_allocator();
+        is_scratch[index] = !alloc.resource()->is_equal(*Allocator{}.resource());
+
+        DynamicArray<isize> temp{alloc};
+        temp.resize(100);
+        data[index] = temp.data();
+    };
+
+    auto const task_a = [&]() -> void { alloc_temp(0); };
+    auto const task_b = [&]() -> void { alloc_temp(1); };
+
+    // NOTE: Calling thread shouldn't help here since it needs to run on the worker
+    pool.submit(&task_a);
+    while (data[0].load() == nullptr)
+        std::this_thread::yield();
+
+    pool.submit(&task_b);
+    while (data[1].load() == nullptr)
+        std::this_thread::yield();
+
+    pool.stop();
+
+    // Scratch memory should be reused once the previous task is done
+    ASSERT_TRUE(is_scratch[0] && is_scratch[1]);
+    ASSERT_EQ(data[0].load(), data[1].load());
+}
+
+UTEST(thread_pool, spin_count)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(2);
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    // Submit one task at a time so workers go idle in between. No wakeups should be lost whether
+    // workers park immediately or spin first.
+    for (isize const spin_count : {0, 1, 1000})
+    {
+        pool.set_spin_count(spin_count);
+        count = 0;
+
+        for (isize i = 0; i < 100; ++i)
+        {
+            pool.submit(&increment);
+            while (count.load() <= i)
+                std::this_thread::yield();
+        }
+
+        ASSERT_EQ(100, count.load());
+    }
+}
+
+UTEST(thread_pool, resize)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(4);
+
+    std::atomic<bool> is_blocked{true};
+    std::atomic<bool> is_started{false};
+    auto const block = [&]() -> void {
+        is_started = true;
+        while (is_blocked.load())
+            std::this_thread::yield();
+    };
+
+    pool.submit(&block);
+    while (!is_started.load())
+        std::this_thread::yield();
+
+    // Shouldn't wait on the blocked task
+    pool.resize(1);
+    ASSERT_EQ(1, pool.num_workers());
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    // Remaining worker may be the blocked one so the calling thread helps out
+    for (isize i = 0; i < 100; ++i)
+        pool.submit(&increment);
+
+    pool.help_while([&]() { return count.load() < 100; });
+    is_blocked = false;
+
+    // Grow past the original size then shrink again
+    pool.resize(6);
+    ASSERT_EQ(6, pool.num_workers());
+
+    for (isize i = 0; i < 100; ++i)
+        pool.submit(&increment);
+
+    pool.resize(2);
+    ASSERT_EQ(2, pool.num_workers());
+
+    // Should finish all tasks before stopping
+    pool.stop();
+    ASSERT_EQ(0, pool.num_workers());
+    ASSERT_EQ(200, count.load());
+}
+
+UTEST(thread_pool, resize_low_priority)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    auto _ = defer([&]() { pool.stop(); });
+
+    // Default limit follows the number of workers
+    pool.start(4);
+    ASSERT_EQ(3, pool.max_low_priority_workers());
+
+    pool.resize(6);
+    ASSERT_EQ(5, pool.max_low_priority_workers());
+
+    // Explicit limit is kept across resizes but can't exceed the number of workers
+    pool.set_max_low_priority_workers(2);
+    ASSERT_EQ(2, pool.max_low_priority_workers());
+
+    pool.resize(8);
+    ASSERT_EQ(2, pool.max_low_priority_workers());
+
+    pool.resize(1);
+    ASSERT_EQ(1, pool.max_low_priority_workers());
+
+    pool.resize(4);
+    ASSERT_EQ(2, pool.max_low_priority_workers());
+}
+
+UTEST(thread_pool, affinity)
+{
+    using namespace dr;
+
+    ASSERT_GE(WorkerPool::num_physical_cores(), 1);
+    ASSERT_GE(WorkerPool::default_num_workers(), 1);
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    // Workers should still run tasks under each policy
+    i32 const cpus[] = {0};
+
+    for (auto const affinity : {WorkerPool::Affinity_PhysicalCores, WorkerPool::Affinity_CpuSet})
+    {
+        WorkerPool pool{};
+        pool.set_name("test-pool");
+        pool.set_affinity(affinity, {cpus, 1});
+        pool.start();
+
+        for (isize i = 0; i < 100; ++i)
+            pool.submit(&increment);
+
+        pool.stop();
+    }
+
+    ASSERT_EQ(200, count.load());
+}
+
+UTEST(thread_pool, inline)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(0);
+    ASSERT_EQ(0, pool.num_workers());
+
+    std::thread::id const main_id = std::this_thread::get_id();
+    DynamicArray<isize> order{};
+    bool is_main_thread = true;
+
+    auto const record = [&](isize const id) -> void {
+        order.push_back(id);
+        is_main_thread &= (std::this_thread::get_id() == main_id);
+    };
+
+    // Nested tasks should run after the task that submitted them rather than recursively
+    auto const task_b = [&]() -> void { record(1); };
+    auto const task_c = [&]() -> void { record(2); };
+    auto const task_a = [&]() -> void {
+        pool.submit(&task_b);
+        pool.submit(&task_c);
+        record(0);
+    };
+
+    pool.submit(&task_a);
+    ASSERT_EQ(3, static_cast<isize>(order.size()));
+    ASSERT_TRUE(is_main_thread);
+
+    for (isize i = 0; i < 3; ++i)
+        ASSERT_EQ(i, order[i]);
+
+    isize const sum = pool.parallel_reduce(
+        0,
+        100,
+        1,
+        isize{0},
+        [](isize const i0, isize const i1) -> isize { return i1 - i0; },
+        [](isize const a, isize const b) -> isize { return a + b; });
+
+    ASSERT_EQ(100, sum);
+
+    // Should be able to switch between modes at runtime
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    pool.resize(2);
+    for (isize i = 0; i < 100; ++i)
+        pool.submit(&increment);
+
+    pool.resize(0);
+    pool.submit(&increment);
+    pool.stop();
+
+    ASSERT_EQ(101, count.load());
+}
+
+#ifdef DR_APP_TASK_STATS
+
+UTEST(thread_pool, stats)
+{
+    using namespace dr;
+
+    WorkerPool pool{};
+    pool.start(2);
+
+    std::atomic<isize> count{0};
+    auto const increment = [&]() -> void { count.fetch_add(1); };
+
+    for (isize i = 0; i < 100; ++i)
+        pool.submit(&increment);
+
+    // NOTE: Calling thread doesn't help so all tasks are run by workers
+    while (count.load() < 100)
+        std::this_thread::yield();
+
+    u64 num_tasks = 0;
+    for (isize i = 0; i < 2; ++i)
+        num_tasks += pool.worker_stats(i).num_tasks;
+
+    ASSERT_EQ(u64{100}, num_tasks);
+    ASSERT_EQ(0, pool.stats().num_queued);
+}
+
+#endif